@@ -0,0 +1,318 @@
+#ifndef CLUSTEREDLIGHTING_H
+#define CLUSTEREDLIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "Shader_s.h"
+#include "Std140.h"
+#include "TransformBatch.h"
+
+// 分簇前向光照：视锥按屏幕 16x9 个块、深度 24 个指数切片分成簇，CPU 把光源分配到与之相交的簇
+// 光源数据、各簇的光源区间与光源下标放在三个缓冲纹理(TBO)中，网格参数放在 Clusters 块中
+// 片段着色器按 gl_FragCoord 与深度找到所在的簇，只遍历影响该簇的光源
+
+// 光源，世界空间；点光源 cosOuter 小于 -1，锥体测试与边缘衰减对它不起作用
+struct clusterLight {
+	glm::vec3 position;
+	float radius;	// 衰减到 0 的距离，也是分簇时的包围球半径
+	glm::vec3 color;
+	glm::vec3 direction;
+	float cosInner;
+	float cosOuter;
+};
+
+// std140 mirror of the Clusters block in shader/light.glsl
+typedef Std140Block<unsigned int, unsigned int, unsigned int, unsigned int, glm::vec2, float, float> ClusterBlock;
+enum ClusterMember { CLUSTER_COUNT_X, CLUSTER_COUNT_Y, CLUSTER_COUNT_Z, CLUSTER_LIGHT_COUNT, CLUSTER_TILE_SIZE,
+	CLUSTER_SLICE_SCALE, CLUSTER_SLICE_BIAS };
+
+class ClusteredLighting {
+private:
+	// 各簇在观察空间的 AABB 与外接球，按切片连续存放，按分量分开
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	std::vector<float> sphereX, sphereY, sphereZ, sphereR;
+	glm::mat4 gridProjection;
+	int gridWidth, gridHeight;
+
+	// 本帧的光源（观察空间）与命中的 (簇, 光源) 对
+	std::vector<clusterLight> viewLights;
+	std::vector<unsigned int> hitClusters;
+	std::vector<unsigned int> hitLights;
+	// 上传的数据：每个光源 3 个 texel，每簇 (起始下标, 个数)，光源下标
+	std::vector<glm::vec4> lightTexels;
+	std::vector<unsigned int> ranges;
+	std::vector<unsigned int> indices;
+
+	unsigned int buffers[3];
+	unsigned int textures[3];
+	unsigned int capacities[3];
+	int maxTexels;
+	bool overflowReported;
+
+	void buildGrid(const glm::mat4& projection, int width, int height);
+	unsigned int slice(float depth) const;
+	// 从 first 开始的 L::width 个簇，result 不大于 0 表示与光源相交
+	template <class L>
+	void testLanes(const clusterLight& light, unsigned int first, float* result) const;
+	void upload(unsigned int index, GLenum format, const void* data, unsigned int count, unsigned int texelSize);
+public:
+	static const unsigned int GRID_X = 16;
+	static const unsigned int GRID_Y = 9;
+	static const unsigned int GRID_Z = 24;
+	static const unsigned int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+	// 三个缓冲纹理占用的纹理单元，避开材质使用的单元
+	static const unsigned int FIRST_UNIT = 12;
+
+	float nearPlane;
+	float farPlane;
+	ClusterBlock block;
+	// 最近一次 update() 的统计
+	unsigned int lightCount;
+	unsigned int indexCount;
+	unsigned int maxPerCluster;
+	double assignTime;	// ms
+
+	// nearPlane / farPlane 与投影矩阵一致
+	ClusteredLighting(float _nearPlane, float _farPlane);
+	~ClusteredLighting();
+
+	// 只上传光源数据，不分簇（延迟着色的光照体直接按下标读取）
+	void uploadLights(const clusterLight* lights, unsigned int count);
+	// 上传光源并把 count 个光源分配到簇，width / height 为帧缓冲大小
+	void update(const clusterLight* lights, unsigned int count, const glm::mat4& view, const glm::mat4& projection,
+		int width, int height);
+	// 绑定缓冲纹理并设置 program 的采样器，program 须为 CLUSTERED_LIGHTS 变体且已是当前程序
+	void bind(Shader& program);
+};
+
+ClusteredLighting::ClusteredLighting(float _nearPlane, float _farPlane) :
+	gridProjection(0.f), gridWidth(0), gridHeight(0), overflowReported(false), nearPlane(_nearPlane), farPlane(_farPlane),
+	lightCount(0), indexCount(0), maxPerCluster(0), assignTime(0.0) {
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	for (unsigned int& capacity : capacities) capacity = 0;
+	maxTexels = 65536;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+	float logRange = std::log(farPlane / nearPlane);
+	block.set<CLUSTER_COUNT_X>(GRID_X);
+	block.set<CLUSTER_COUNT_Y>(GRID_Y);
+	block.set<CLUSTER_COUNT_Z>(GRID_Z);
+	block.set<CLUSTER_LIGHT_COUNT>(0u);
+	block.set<CLUSTER_SLICE_SCALE>((float)GRID_Z / logRange);
+	block.set<CLUSTER_SLICE_BIAS>(-(float)GRID_Z * std::log(nearPlane) / logRange);
+}
+
+ClusteredLighting::~ClusteredLighting() {
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+}
+
+// 切片 k 覆盖深度 near * (far / near)^(k / Z) 到 near * (far / near)^((k + 1) / Z)
+unsigned int ClusteredLighting::slice(float depth) const {
+	if (depth <= nearPlane) return 0;
+	float k = std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * (float)GRID_Z;
+	return k >= (float)(GRID_Z - 1) ? GRID_Z - 1 : (unsigned int)k;
+}
+
+void ClusteredLighting::buildGrid(const glm::mat4& projection, int width, int height) {
+	gridProjection = projection;
+	gridWidth = width;
+	gridHeight = height;
+	block.set<CLUSTER_TILE_SIZE>(glm::vec2((float)width / GRID_X, (float)height / GRID_Y));
+
+	for (std::vector<float>* component : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ, &sphereX, &sphereY, &sphereZ, &sphereR })
+		component->resize(CLUSTER_COUNT);
+	// 对称透视投影下，深度 d 处 NDC 坐标 ndc 对应观察空间 ndc * d / P[0][0]（y 用 P[1][1]）
+	float invX = 1.f / projection[0][0], invY = 1.f / projection[1][1];
+	for (unsigned int z = 0; z < GRID_Z; z++) {
+		float nearDepth = nearPlane * std::pow(farPlane / nearPlane, (float)z / GRID_Z);
+		float farDepth = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / GRID_Z);
+		for (unsigned int y = 0; y < GRID_Y; y++)
+			for (unsigned int x = 0; x < GRID_X; x++) {
+				unsigned int i = x + GRID_X * (y + GRID_Y * z);
+				float ndcX[2] = { -1.f + 2.f * x / GRID_X, -1.f + 2.f * (x + 1) / GRID_X };
+				float ndcY[2] = { -1.f + 2.f * y / GRID_Y, -1.f + 2.f * (y + 1) / GRID_Y };
+				glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+				for (float depth : { nearDepth, farDepth })
+					for (int k = 0; k < 2; k++) {
+						float vx = ndcX[k] * depth * invX, vy = ndcY[k] * depth * invY;
+						lo.x = vx < lo.x ? vx : lo.x; hi.x = vx > hi.x ? vx : hi.x;
+						lo.y = vy < lo.y ? vy : lo.y; hi.y = vy > hi.y ? vy : hi.y;
+					}
+				lo.z = -farDepth;
+				hi.z = -nearDepth;
+				glm::vec3 center = (lo + hi) * .5f;
+				minX[i] = lo.x; minY[i] = lo.y; minZ[i] = lo.z;
+				maxX[i] = hi.x; maxY[i] = hi.y; maxZ[i] = hi.z;
+				sphereX[i] = center.x; sphereY[i] = center.y; sphereZ[i] = center.z;
+				sphereR[i] = glm::length(hi - center);
+			}
+	}
+}
+
+// 球与 AABB：到盒的最近距离平方减去半径平方
+// 聚光灯再用簇的外接球测试锥体：球心到锥面的距离超过球半径，或整体在锥顶之后、超出光照距离时不相交
+template <class L>
+void ClusteredLighting::testLanes(const clusterLight& light, unsigned int first, float* result) const {
+	typedef typename L::type V;
+	const V zero = L::set1(0.f);
+	V px = L::set1(light.position.x), py = L::set1(light.position.y), pz = L::set1(light.position.z);
+	V dx = L::add(L::maximum(L::sub(L::load(&minX[first]), px), zero), L::maximum(L::sub(px, L::load(&maxX[first])), zero));
+	V dy = L::add(L::maximum(L::sub(L::load(&minY[first]), py), zero), L::maximum(L::sub(py, L::load(&maxY[first])), zero));
+	V dz = L::add(L::maximum(L::sub(L::load(&minZ[first]), pz), zero), L::maximum(L::sub(pz, L::load(&maxZ[first])), zero));
+	V outside = L::sub(L::add(L::add(L::mul(dx, dx), L::mul(dy, dy)), L::mul(dz, dz)), L::set1(light.radius * light.radius));
+
+	// 只对小于 90 度的锥体成立
+	if (light.cosOuter > 0.f) {
+		float sinOuter = std::sqrt(1.f - light.cosOuter * light.cosOuter);
+		V vx = L::sub(L::load(&sphereX[first]), px), vy = L::sub(L::load(&sphereY[first]), py), vz = L::sub(L::load(&sphereZ[first]), pz);
+		V r = L::load(&sphereR[first]);
+		V lengthSq = L::add(L::add(L::mul(vx, vx), L::mul(vy, vy)), L::mul(vz, vz));
+		V axial = L::add(L::add(L::mul(vx, L::set1(light.direction.x)), L::mul(vy, L::set1(light.direction.y))),
+			L::mul(vz, L::set1(light.direction.z)));
+		V radial = L::squareRoot(L::maximum(L::sub(lengthSq, L::mul(axial, axial)), zero));
+		V cone = L::sub(L::mul(L::set1(light.cosOuter), radial), L::mul(L::set1(sinOuter), axial));
+		outside = L::maximum(outside, L::sub(cone, r));
+		outside = L::maximum(outside, L::sub(L::sub(axial, r), L::set1(light.radius)));
+		outside = L::maximum(outside, L::sub(L::sub(zero, axial), r));
+	}
+	L::store(result, outside);
+}
+
+void ClusteredLighting::update(const clusterLight* lights, unsigned int count, const glm::mat4& view, const glm::mat4& projection,
+	int width, int height) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (projection != gridProjection || width != gridWidth || height != gridHeight)
+		buildGrid(projection, width, height);
+
+	// 数据纹理中的光源保持世界空间，分簇用观察空间
+	uploadLights(lights, count);
+	viewLights.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		const clusterLight& light = lights[i];
+		viewLights[i] = light;
+		viewLights[i].position = glm::vec3(view * glm::vec4(light.position, 1.f));
+		viewLights[i].direction = glm::vec3(view * glm::vec4(light.direction, 0.f));
+	}
+
+	// 按光源遍历，只测试其深度范围覆盖的切片，每次 8 个簇
+	hitClusters.clear();
+	hitLights.clear();
+	float results[8];
+	const unsigned int sliceSize = GRID_X * GRID_Y;
+	for (unsigned int l = 0; l < count; l++) {
+		const clusterLight& light = viewLights[l];
+		float depth = -light.position.z;
+		if (depth + light.radius < nearPlane || depth - light.radius > farPlane) continue;
+		unsigned int end = (slice(depth + light.radius) + 1) * sliceSize;
+		unsigned int i = slice(depth - light.radius) * sliceSize;
+		for (; i + 8 <= end; i += 8) {
+			for (unsigned int lane = 0; lane < 8; lane += simdLane::width)
+				testLanes<simdLane>(light, i + lane, results + lane);
+			for (unsigned int k = 0; k < 8; k++)
+				if (results[k] <= 0.f) {
+					hitClusters.push_back(i + k);
+					hitLights.push_back(l);
+				}
+		}
+		for (; i < end; i++) {
+			testLanes<scalarLane>(light, i, results);
+			if (results[0] <= 0.f) {
+				hitClusters.push_back(i);
+				hitLights.push_back(l);
+			}
+		}
+	}
+
+	// 按簇计数排序，簇内保持光源顺序
+	ranges.assign(CLUSTER_COUNT * 2, 0);
+	for (unsigned int cluster : hitClusters)
+		ranges[cluster * 2 + 1]++;
+	unsigned int offset = 0;
+	maxPerCluster = 0;
+	for (unsigned int c = 0; c < CLUSTER_COUNT; c++) {
+		ranges[c * 2] = offset;
+		offset += ranges[c * 2 + 1];
+		if (ranges[c * 2 + 1] > maxPerCluster) maxPerCluster = ranges[c * 2 + 1];
+		ranges[c * 2 + 1] = 0;
+	}
+	indices.resize(hitClusters.size());
+	for (unsigned int h = 0; h < hitClusters.size(); h++) {
+		unsigned int* range = &ranges[hitClusters[h] * 2];
+		indices[range[0] + range[1]++] = hitLights[h];
+	}
+
+	// 下标超出缓冲纹理上限时截断，被截掉的簇少算一部分光源
+	if (indices.size() > (size_t)maxTexels) {
+		if (!overflowReported) {
+			std::cout << "WARNING::CLUSTEREDLIGHTING::INDEX_OVERFLOW: " << indices.size() << " > " << maxTexels << std::endl;
+			overflowReported = true;
+		}
+		indices.resize(maxTexels);
+		for (unsigned int c = 0; c < CLUSTER_COUNT; c++) {
+			unsigned int first = ranges[c * 2], last = first + ranges[c * 2 + 1];
+			if (last > (unsigned int)maxTexels) ranges[c * 2 + 1] = first < (unsigned int)maxTexels ? maxTexels - first : 0;
+		}
+	}
+
+	upload(1, GL_RG32UI, ranges.data(), CLUSTER_COUNT, sizeof(unsigned int) * 2);
+	upload(2, GL_R32UI, indices.data(), (unsigned int)indices.size(), sizeof(unsigned int));
+	indexCount = (unsigned int)indices.size();
+	assignTime = elapsedMilliseconds(start);
+}
+
+void ClusteredLighting::uploadLights(const clusterLight* lights, unsigned int count) {
+	lightTexels.resize(count * 3);
+	for (unsigned int i = 0; i < count; i++) {
+		const clusterLight& light = lights[i];
+		lightTexels[i * 3] = glm::vec4(light.position, light.radius);
+		lightTexels[i * 3 + 1] = glm::vec4(light.color, light.cosInner);
+		lightTexels[i * 3 + 2] = glm::vec4(light.direction, light.cosOuter);
+	}
+	upload(0, GL_RGBA32F, lightTexels.data(), (unsigned int)lightTexels.size(), sizeof(glm::vec4));
+	block.set<CLUSTER_LIGHT_COUNT>(count);
+	lightCount = count;
+	indexCount = 0;
+	maxPerCluster = 0;
+}
+
+// 容量不够时按 2 倍增长；每次孤立整个缓冲再写入，不等待上一帧的读取
+void ClusteredLighting::upload(unsigned int index, GLenum format, const void* data, unsigned int count, unsigned int texelSize) {
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[index]);
+	bool grown = false;
+	unsigned int needed = count > 0 ? count : 1;
+	if (needed > capacities[index]) {
+		capacities[index] = capacities[index] * 2 > needed ? capacities[index] * 2 : needed;
+		grown = true;
+	}
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)capacities[index] * texelSize, NULL, GL_STREAM_DRAW);
+	if (count > 0)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)count * texelSize, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (grown) {
+		glBindTexture(GL_TEXTURE_BUFFER, textures[index]);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[index]);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+void ClusteredLighting::bind(Shader& program) {
+	for (unsigned int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	program.setInt("clusterLights"_u, FIRST_UNIT);
+	program.setInt("clusterRanges"_u, FIRST_UNIT + 1);
+	program.setInt("clusterIndices"_u, FIRST_UNIT + 2);
+}
+
+#endif
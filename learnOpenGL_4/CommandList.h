@@ -0,0 +1,278 @@
+#ifndef COMMANDLIST_H
+#define COMMANDLIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Shader_s.h"
+#include "Std140.h"
+#include "UniformRing.h"
+
+// 与图形 API 无关的绘制命令，录制时不调用任何 GL 函数，可以在工作线程中进行
+enum renderCommandType {
+	CMD_USE_PROGRAM,
+	CMD_SET_INT,
+	CMD_SET_FLOAT,
+	CMD_SET_VEC3,
+	CMD_SET_MAT4,
+	CMD_BIND_TEXTURE,
+	CMD_BIND_VERTEX_ARRAY,
+	CMD_BIND_UNIFORM_BLOCK,
+	CMD_DRAW_ELEMENTS
+};
+
+struct renderCommand {
+	renderCommandType type;
+	unsigned int arg;	// uniform 句柄 / 纹理单元 / VAO / 绑定点 / 索引数
+	unsigned int arg2;	// 纹理 / 实例数
+	unsigned int offset;	// 数据在 payload 中的位置
+	unsigned int size;
+	Shader* program;
+};
+
+// 命令列表：命令与其数据（uniform 值、逐对象 uniform 块）分开连续存放
+// 每个线程录制自己的列表，GL 线程按顺序用 replayCommandList() 回放
+class CommandList {
+private:
+	renderCommand& push(renderCommandType type, unsigned int arg = 0, unsigned int arg2 = 0);
+	void pushData(renderCommand& command, const void* data, unsigned int size);
+public:
+	std::vector<renderCommand> commands;
+	std::vector<unsigned char> payload;
+
+	void clear();
+	unsigned int size() const { return (unsigned int)commands.size(); }
+
+	void useProgram(Shader& program);
+	// 作用于最近一次 useProgram 的程序
+	void setInt(UniformHandle handle, int value);
+	void setFloat(UniformHandle handle, float value);
+	void setVec3f(UniformHandle handle, const glm::vec3& value);
+	void setMat4f(UniformHandle handle, const glm::mat4& value);
+	void bindTexture(unsigned int unit, unsigned int texture);
+	void bindVertexArray(unsigned int vao);
+	// 数据在回放时写入环形缓冲并绑定到 binding
+	void bindUniformBlock(unsigned int binding, const void* data, unsigned int size);
+	template <class... Ts>
+	void bindUniformBlock(unsigned int binding, const Std140Block<Ts...>& block) {
+		bindUniformBlock(binding, block.data(), block.size());
+	}
+	// instances 大于 1 时为实例化绘制
+	void drawElements(unsigned int count, unsigned int instances = 1);
+};
+
+// 在 GL 线程回放，useProgram 负责切换程序（与 RenderQueue::execute 相同）
+void replayCommandList(const CommandList& list, UniformRingBuffer& ring, const std::function<void(Shader&)>& useProgram);
+
+// 常驻的录制线程，run() 把一组任务分给各线程（调用线程也参与）并等待全部完成
+class CommandRecorder {
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable startSignal;
+	std::condition_variable doneSignal;
+	const std::vector<std::function<void()> >* jobs;
+	std::atomic<unsigned int> next;
+	unsigned int generation;
+	unsigned int busy;
+	bool quit;
+
+	void work();
+	void worker();
+public:
+	// 最近一次 run() 的耗时(ms)
+	double recordTime;
+
+	// threadCount 为 0 时取 hardware_concurrency - 1
+	CommandRecorder(unsigned int threadCount = 0);
+	~CommandRecorder();
+
+	void run(const std::vector<std::function<void()> >& _jobs);
+	unsigned int threadCount() const { return (unsigned int)threads.size() + 1; }
+};
+
+renderCommand& CommandList::push(renderCommandType type, unsigned int arg, unsigned int arg2) {
+	renderCommand command;
+	command.type = type;
+	command.arg = arg;
+	command.arg2 = arg2;
+	command.offset = 0;
+	command.size = 0;
+	command.program = NULL;
+	commands.push_back(command);
+	return commands.back();
+}
+
+void CommandList::pushData(renderCommand& command, const void* data, unsigned int size) {
+	command.offset = (unsigned int)payload.size();
+	command.size = size;
+	payload.insert(payload.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+}
+
+void CommandList::clear() {
+	commands.clear();
+	payload.clear();
+}
+
+void CommandList::useProgram(Shader& program) {
+	push(CMD_USE_PROGRAM).program = &program;
+}
+
+void CommandList::setInt(UniformHandle handle, int value) {
+	pushData(push(CMD_SET_INT, handle.hash), &value, sizeof(value));
+}
+
+void CommandList::setFloat(UniformHandle handle, float value) {
+	pushData(push(CMD_SET_FLOAT, handle.hash), &value, sizeof(value));
+}
+
+void CommandList::setVec3f(UniformHandle handle, const glm::vec3& value) {
+	pushData(push(CMD_SET_VEC3, handle.hash), &value.x, sizeof(float) * 3);
+}
+
+void CommandList::setMat4f(UniformHandle handle, const glm::mat4& value) {
+	pushData(push(CMD_SET_MAT4, handle.hash), &value[0][0], sizeof(float) * 16);
+}
+
+void CommandList::bindTexture(unsigned int unit, unsigned int texture) {
+	push(CMD_BIND_TEXTURE, unit, texture);
+}
+
+void CommandList::bindVertexArray(unsigned int vao) {
+	push(CMD_BIND_VERTEX_ARRAY, vao);
+}
+
+void CommandList::bindUniformBlock(unsigned int binding, const void* data, unsigned int size) {
+	pushData(push(CMD_BIND_UNIFORM_BLOCK, binding), data, size);
+}
+
+void CommandList::drawElements(unsigned int count, unsigned int instances) {
+	push(CMD_DRAW_ELEMENTS, count, instances);
+}
+
+void replayCommandList(const CommandList& list, UniformRingBuffer& ring, const std::function<void(Shader&)>& useProgram) {
+	Shader* program = NULL;
+	for (const renderCommand& command : list.commands) {
+		const unsigned char* data = list.payload.data() + command.offset;
+		switch (command.type) {
+		case CMD_USE_PROGRAM:
+			program = command.program;
+			useProgram(*program);
+			break;
+		case CMD_SET_INT: {
+			int value;
+			std::memcpy(&value, data, sizeof(value));
+			program->setInt(UniformHandle(command.arg), value);
+			break;
+		}
+		case CMD_SET_FLOAT: {
+			float value;
+			std::memcpy(&value, data, sizeof(value));
+			program->setFloat(UniformHandle(command.arg), value);
+			break;
+		}
+		case CMD_SET_VEC3: {
+			glm::vec3 value;
+			std::memcpy(&value.x, data, sizeof(float) * 3);
+			program->setVec3f(UniformHandle(command.arg), value);
+			break;
+		}
+		case CMD_SET_MAT4: {
+			glm::mat4 value;
+			std::memcpy(&value[0][0], data, sizeof(float) * 16);
+			program->setMat4f(UniformHandle(command.arg), value);
+			break;
+		}
+		case CMD_BIND_TEXTURE:
+			glActiveTexture(GL_TEXTURE0 + command.arg);
+			glBindTexture(GL_TEXTURE_2D, command.arg2);
+			glActiveTexture(GL_TEXTURE0);
+			break;
+		case CMD_BIND_VERTEX_ARRAY:
+			glBindVertexArray(command.arg);
+			break;
+		case CMD_BIND_UNIFORM_BLOCK:
+			ring.bind(command.arg, data, command.size);
+			break;
+		case CMD_DRAW_ELEMENTS:
+			if (command.arg2 > 1)
+				glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)command.arg, GL_UNSIGNED_INT, 0, (GLsizei)command.arg2);
+			else
+				glDrawElements(GL_TRIANGLES, (GLsizei)command.arg, GL_UNSIGNED_INT, 0);
+			break;
+		}
+	}
+}
+
+CommandRecorder::CommandRecorder(unsigned int threadCount) :
+	jobs(NULL), next(0), generation(0), busy(0), quit(false), recordTime(0.0) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+		threadCount = threadCount > 1 ? threadCount - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+		threads.push_back(std::thread(&CommandRecorder::worker, this));
+}
+
+CommandRecorder::~CommandRecorder() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	startSignal.notify_all();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+// 取任务直到取完
+void CommandRecorder::work() {
+	for (unsigned int k = next++; k < jobs->size(); k = next++)
+		(*jobs)[k]();
+}
+
+void CommandRecorder::worker() {
+	unsigned int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startSignal.wait(lock, [&]() { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+		work();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy--;
+		}
+		doneSignal.notify_one();
+	}
+}
+
+void CommandRecorder::run(const std::vector<std::function<void()> >& _jobs) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs = &_jobs;
+		next = 0;
+		busy = (unsigned int)threads.size();
+		generation++;
+	}
+	startSignal.notify_all();
+	work();
+	// 各线程都要确认过本轮，jobs 才能在返回后失效
+	std::unique_lock<std::mutex> lock(mutex);
+	doneSignal.wait(lock, [&]() { return busy == 0; });
+	jobs = NULL;
+	recordTime = elapsedMilliseconds(start);
+}
+
+#endif
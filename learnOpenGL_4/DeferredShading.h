@@ -0,0 +1,266 @@
+#ifndef DEFERREDSHADING_H
+#define DEFERREDSHADING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "Shader_s.h"
+
+// 延迟着色：几何阶段把反照率 + 高光强度、法线、深度写入 G-buffer，每个像素的材质只采样一次
+// 光照阶段在累加缓冲上叠加：平行光/单个点光源/聚光灯画一个全屏三角形，光源池中的光源画光照体（球）
+// 光照体只着色被它包住的表面，有两种剔除方式：
+//   深度：画背面并以 GL_GEQUAL 测试，表面在球背面之前才着色，一次实例化绘制画完所有光源
+//   模板：每个光源先用两面模板测试标记落在球内的表面，再只着色被标记的像素并清除标记，剔除更准但每个光源两次绘制
+// 最后合成到目标帧缓冲，同时写入深度，之后的前向绘制照常进行深度测试
+class DeferredShading {
+private:
+	unsigned int FBO;
+	unsigned int textures[4];	// 反照率 + 高光强度、法线、深度、光照累加
+	unsigned int depthStencil;
+	unsigned int volumeVAO, volumeVBO, volumeEBO;
+	unsigned int volumeIndexCount;
+	unsigned int emptyVAO;	// 全屏三角形不需要顶点缓冲
+	int width, height;
+
+	void resize(int _width, int _height);
+	void buildVolume();
+public:
+	// G-buffer 与累加缓冲占用的纹理单元，与材质、ClusteredLighting 的单元错开
+	static const unsigned int FIRST_UNIT = 8;
+
+	bool stencilCulling;
+	// 最近一次 drawVolumes() 的绘制调用数
+	unsigned int volumeDraws;
+
+	DeferredShading();
+	~DeferredShading();
+
+	// 几何阶段：绑定并清空 G-buffer，之后用 gbuffer.frag 绘制不透明物体
+	void beginGeometry(int _width, int _height);
+	// 光照阶段：切换到累加缓冲，关闭深度写入，开启叠加混合
+	void beginLighting();
+	// 绑定 G-buffer 纹理并设置 program 的采样器，program 须已是当前程序
+	void bindTextures(Shader& program);
+	void drawFullscreen();
+	// program 为 LIGHT_VOLUMES 变体，按实例号从光源池的缓冲纹理中取第 firstLight 起的 count 个光源
+	void drawVolumes(Shader& program, unsigned int count);
+	// 恢复主循环的默认状态并绑定回默认帧缓冲
+	void endLighting();
+	// 把累加结果与 G-buffer 深度写入当前帧缓冲，program 为 COMPOSITE 变体
+	void composite(Shader& program);
+};
+
+DeferredShading::DeferredShading() : width(0), height(0), stencilCulling(false), volumeDraws(0) {
+	glGenFramebuffers(1, &FBO);
+	glGenTextures(4, textures);
+	glGenRenderbuffers(1, &depthStencil);
+	glGenVertexArrays(1, &emptyVAO);
+	buildVolume();
+}
+
+DeferredShading::~DeferredShading() {
+	glDeleteFramebuffers(1, &FBO);
+	glDeleteTextures(4, textures);
+	glDeleteRenderbuffers(1, &depthStencil);
+	glDeleteVertexArrays(1, &emptyVAO);
+	glDeleteVertexArrays(1, &volumeVAO);
+	glDeleteBuffers(1, &volumeVBO);
+	glDeleteBuffers(1, &volumeEBO);
+}
+
+void DeferredShading::resize(int _width, int _height) {
+	width = _width;
+	height = _height;
+	const GLint internalFormats[4] = { GL_RGBA8, GL_RGBA16F, GL_R32F, GL_RGBA16F };
+	const GLenum formats[4] = { GL_RGBA, GL_RGBA, GL_RED, GL_RGBA };
+	const GLenum types[4] = { GL_UNSIGNED_BYTE, GL_FLOAT, GL_FLOAT, GL_FLOAT };
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	for (int i = 0; i < 4; i++) {
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	// 深度测试与模板只用渲染缓冲；光照阶段读的是颜色附件里的深度，避免对同一附件边测试边采样
+	glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::DEFERREDSHADING::FRAMEBUFFER_INCOMPLETE" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// 细分一次的二十面体，顶点外推到各面都在单位球之外，保证光照体包住整个光照范围
+void DeferredShading::buildVolume() {
+	const float t = (1.f + std::sqrt(5.f)) * .5f;
+	std::vector<glm::vec3> vertices = {
+		{ -1.f, t, 0.f }, { 1.f, t, 0.f }, { -1.f, -t, 0.f }, { 1.f, -t, 0.f },
+		{ 0.f, -1.f, t }, { 0.f, 1.f, t }, { 0.f, -1.f, -t }, { 0.f, 1.f, -t },
+		{ t, 0.f, -1.f }, { t, 0.f, 1.f }, { -t, 0.f, -1.f }, { -t, 0.f, 1.f }
+	};
+	for (glm::vec3& vertex : vertices) vertex = glm::normalize(vertex);
+	std::vector<unsigned int> faces = {
+		0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+		1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+		3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+		4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+	};
+	// 每条边的中点只建一次
+	std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+	auto midpoint = [&](unsigned int a, unsigned int b) {
+		std::pair<unsigned int, unsigned int> key(a < b ? a : b, a < b ? b : a);
+		auto it = midpoints.find(key);
+		if (it != midpoints.end()) return it->second;
+		vertices.push_back(glm::normalize(vertices[a] + vertices[b]));
+		unsigned int index = (unsigned int)vertices.size() - 1;
+		midpoints[key] = index;
+		return index;
+	};
+	std::vector<unsigned int> indices;
+	for (unsigned int f = 0; f < faces.size(); f += 3) {
+		unsigned int a = faces[f], b = faces[f + 1], c = faces[f + 2];
+		unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+		unsigned int split[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+		indices.insert(indices.end(), split, split + 12);
+	}
+	// 最近的面到球心的距离
+	float inradius = 1.f;
+	for (unsigned int i = 0; i < indices.size(); i += 3) {
+		const glm::vec3& a = vertices[indices[i]];
+		glm::vec3 n = glm::normalize(glm::cross(vertices[indices[i + 1]] - a, vertices[indices[i + 2]] - a));
+		float distance = std::fabs(glm::dot(n, a));
+		inradius = distance < inradius ? distance : inradius;
+	}
+	for (glm::vec3& vertex : vertices) vertex = vertex / inradius;
+	volumeIndexCount = (unsigned int)indices.size();
+
+	glGenVertexArrays(1, &volumeVAO);
+	glGenBuffers(1, &volumeVBO);
+	glGenBuffers(1, &volumeEBO);
+	glBindVertexArray(volumeVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredShading::beginGeometry(int _width, int _height) {
+	if (_width != width || _height != height)
+		resize(_width, _height);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, attachments);
+	const float zero[4] = { 0.f, 0.f, 0.f, 0.f };
+	const float farDepth[4] = { 1.f, 1.f, 1.f, 1.f };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, zero);
+	glClearBufferfv(GL_COLOR, 2, farDepth);
+	glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+}
+
+void DeferredShading::beginLighting() {
+	glDrawBuffer(GL_COLOR_ATTACHMENT3);
+	const float zero[4] = { 0.f, 0.f, 0.f, 0.f };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	for (unsigned int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	volumeDraws = 0;
+}
+
+void DeferredShading::bindTextures(Shader& program) {
+	program.setInt("gAlbedoSpec"_u, FIRST_UNIT);
+	program.setInt("gNormal"_u, FIRST_UNIT + 1);
+	program.setInt("gDepth"_u, FIRST_UNIT + 2);
+	program.setInt("lightAccum"_u, FIRST_UNIT + 3);
+}
+
+void DeferredShading::drawFullscreen() {
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+}
+
+void DeferredShading::drawVolumes(Shader& program, unsigned int count) {
+	if (count == 0) return;
+	glBindVertexArray(volumeVAO);
+	glEnable(GL_CULL_FACE);
+	if (!stencilCulling) {
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GEQUAL);
+		glCullFace(GL_FRONT);
+		program.setInt("firstLight"_u, 0);
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)volumeIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)count);
+		volumeDraws++;
+	}
+	else {
+		glEnable(GL_STENCIL_TEST);
+		// 只在开始时清一次，之后每个光源着色时把标记过的像素归零，留给下一个光源
+		glClear(GL_STENCIL_BUFFER_BIT);
+		for (unsigned int i = 0; i < count; i++) {
+			program.setInt("firstLight"_u, (int)i);
+			// 背面在表面之后 +1，正面在表面之后 -1，非 0 处的表面在球内
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LESS);
+			glDisable(GL_CULL_FACE);
+			glStencilFunc(GL_ALWAYS, 0, 0);
+			glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+			glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+			glDrawElements(GL_TRIANGLES, (GLsizei)volumeIndexCount, GL_UNSIGNED_INT, 0);
+			// 着色被标记的像素并归零，画背面使相机在球内时同样有效；闭合的球背面覆盖它能标记的每个像素
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDisable(GL_DEPTH_TEST);
+			glEnable(GL_CULL_FACE);
+			glCullFace(GL_FRONT);
+			glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+			glDrawElements(GL_TRIANGLES, (GLsizei)volumeIndexCount, GL_UNSIGNED_INT, 0);
+			volumeDraws += 2;
+		}
+		glDisable(GL_STENCIL_TEST);
+	}
+	glBindVertexArray(0);
+	glDisable(GL_DEPTH_TEST);
+}
+
+void DeferredShading::endLighting() {
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredShading::composite(Shader& program) {
+	glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + 3);
+	glBindTexture(GL_TEXTURE_2D, textures[3]);
+	glActiveTexture(GL_TEXTURE0);
+	bindTextures(program);
+	// 深度测试须开启才会写入 gl_FragDepth
+	glDepthFunc(GL_ALWAYS);
+	drawFullscreen();
+	glDepthFunc(GL_LESS);
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <LearnOpenGL/mesh.h>
+
+// 深度预渲染：先关闭颜色写入、只用位置画一遍不透明物体，光照阶段再以 GL_EQUAL 测试且不写深度
+// 重叠的头发、衣服与地面只有最前面的片段执行光照着色器
+// 镂空网格（漫反射纹理带透明像素）在预渲染里会把透明处写成实心的深度，因此不参与预渲染，
+// 留到光照阶段之后照常以 GL_LESS 绘制并写深度
+// 各阶段通过深度测试的样本数用 GL_SAMPLES_PASSED 统计，查询按帧轮换，读两帧前的结果，从不等待 GPU
+enum PrepassCounter {
+	SAMPLES_PREPASS,	// 预渲染通过的样本，即不做预渲染时不透明物体会着色的数量
+	SAMPLES_SHADED,	// 光照阶段着色的样本
+	SAMPLES_CUTOUT,	// 预渲染之后补画的镂空网格
+	SAMPLES_COUNTERS
+};
+
+class DepthPrepass {
+private:
+	static const unsigned int FRAMES = 3;
+
+	std::map<unsigned int, bool> cutoutTextures;	// 纹理 -> 是否有透明像素
+	std::vector<unsigned int> queries[FRAMES];
+	std::vector<unsigned int> counters[FRAMES];	// 各查询计入的计数器
+	unsigned int used[FRAMES];
+	unsigned int frame;
+	bool counting;
+public:
+	// 低于该值的 alpha 视为镂空
+	static const unsigned char ALPHA_CUTOFF = 128;
+
+	// 最近读到的一帧各计数器的样本数，多重采样时每个片段计入多个样本
+	unsigned long long samples[SAMPLES_COUNTERS];
+
+	DepthPrepass();
+	~DepthPrepass();
+
+	// 网格的第一张漫反射纹理是否有 alpha 低于 ALPHA_CUTOFF 的像素，每张纹理只回读一次，须在 GL 线程调用
+	bool cutout(const Mesh& mesh);
+
+	// 每帧开始时调用，轮换查询并读取两帧前的结果
+	void beginFrame();
+	// 之后的查询段通过测试的样本计入 counter，段不能嵌套，也不能与遮挡查询重叠
+	void beginCount(PrepassCounter counter);
+	void endCount();
+
+	// 预渲染：关闭颜色写入，GL_LESS 并写深度
+	void beginDepth();
+	// 光照：恢复颜色写入，GL_EQUAL 且不写深度
+	void beginShading();
+	// 镂空网格：恢复 GL_LESS 与深度写入，也是帧内其余绘制的默认状态
+	void endShading();
+};
+
+DepthPrepass::DepthPrepass() : frame(0), counting(false) {
+	for (unsigned int i = 0; i < FRAMES; i++) used[i] = 0;
+	for (unsigned long long& count : samples) count = 0;
+}
+
+DepthPrepass::~DepthPrepass() {
+	for (unsigned int i = 0; i < FRAMES; i++)
+		if (!queries[i].empty())
+			glDeleteQueries((GLsizei)queries[i].size(), queries[i].data());
+}
+
+bool DepthPrepass::cutout(const Mesh& mesh) {
+	unsigned int texture = 0;
+	for (const Texture& candidate : mesh.textures)
+		if (candidate.type == "texture_diffuse") {
+			texture = candidate.id;
+			break;
+		}
+	if (texture == 0) return false;
+	auto it = cutoutTextures.find(texture);
+	if (it != cutoutTextures.end()) return it->second;
+
+	bool result = false;
+	int width = 0, height = 0, alphaSize = 0;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_ALPHA_SIZE, &alphaSize);
+	// 没有 alpha 通道的纹理读出来恒为 1，不必回读
+	if (alphaSize > 0 && width > 0 && height > 0) {
+		// 核心模式没有 GL_ALPHA 像素格式，按 RGBA 读出后隔四个字节取 alpha
+		std::vector<unsigned char> pixels((std::size_t)width * height * 4);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		for (std::size_t i = 3; i < pixels.size(); i += 4)
+			if (pixels[i] < ALPHA_CUTOFF) {
+				result = true;
+				break;
+			}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	cutoutTextures[texture] = result;
+	return result;
+}
+
+void DepthPrepass::beginFrame() {
+	frame++;
+	used[frame % FRAMES] = 0;
+	// 两帧前的一组：最后一个结果已出时前面的也都已出
+	unsigned int previous = (frame + 1) % FRAMES;
+	unsigned int count = used[previous];
+	if (count == 0) return;
+	int available = GL_FALSE;
+	glGetQueryObjectiv(queries[previous][count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return;
+	for (unsigned long long& total : samples) total = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		GLuint64 passed = 0;
+		glGetQueryObjectui64v(queries[previous][i], GL_QUERY_RESULT, &passed);
+		samples[counters[previous][i]] += passed;
+	}
+}
+
+void DepthPrepass::beginCount(PrepassCounter counter) {
+	unsigned int current = frame % FRAMES;
+	if (used[current] == queries[current].size()) {
+		unsigned int query;
+		glGenQueries(1, &query);
+		queries[current].push_back(query);
+		counters[current].push_back(counter);
+	}
+	counters[current][used[current]] = counter;
+	glBeginQuery(GL_SAMPLES_PASSED, queries[current][used[current]++]);
+	counting = true;
+}
+
+void DepthPrepass::endCount() {
+	if (!counting) return;
+	glEndQuery(GL_SAMPLES_PASSED);
+	counting = false;
+}
+
+void DepthPrepass::beginDepth() {
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+void DepthPrepass::beginShading() {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+}
+
+void DepthPrepass::endShading() {
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 模拟线程与渲染线程之间的帧流水线
+// 模拟线程以固定步长推进并把结果写成快照，经三重缓冲交给渲染线程；渲染线程总是取最新的一份
+// 两边都不会等待对方，一边的慢帧只会让另一边重复使用或跳过快照
+
+// 无锁三重缓冲：写端与读端各持有一份，中间一份用原子交换传递
+template <class T>
+class TripleBuffer {
+private:
+	static const unsigned int FRESH = 4;	// 中间一份是否比读端的新
+
+	T buffers[3];
+	std::atomic<unsigned int> middle;
+	unsigned int writing;
+	unsigned int reading;
+public:
+	TripleBuffer() : middle(1), writing(0), reading(2) {}
+
+	// 写端：填好 writeBuffer() 后 publish()
+	T& writeBuffer() { return buffers[writing]; }
+	void publish();
+	// 读端：有新快照时换入并返回 true，之后 readBuffer() 在下次 acquire() 之前保持不变
+	bool acquire();
+	const T& readBuffer() const { return buffers[reading]; }
+};
+
+// 主线程收集、其他线程按顺序取走的事件队列
+template <class T>
+class EventQueue {
+private:
+	std::mutex mutex;
+	std::vector<T> pending;
+public:
+	void push(const T& event);
+	// 取走全部事件追加到 events
+	void drain(std::vector<T>& events);
+};
+
+// 以固定步长在独立线程中运行 step，每轮追赶完积压的步数后调用一次 publish
+class FixedStepThread {
+private:
+	std::thread thread;
+	std::atomic<bool> running;
+	std::function<void(double)> step;
+	std::function<void()> publish;
+
+	void loop();
+public:
+	// 步长(s)与单轮最多追赶的步数，超过时丢弃积压的时间，避免越追越慢
+	double timestep;
+	unsigned int maxSteps;
+	// 累计步数与丢弃的步数
+	std::atomic<unsigned long long> steps;
+	std::atomic<unsigned long long> droppedSteps;
+
+	FixedStepThread(double _timestep, const std::function<void(double)>& _step, const std::function<void()>& _publish,
+		unsigned int _maxSteps = 5);
+	~FixedStepThread();
+
+	void start();
+	void stop();
+};
+
+template <class T>
+void TripleBuffer<T>::publish() {
+	unsigned int previous = middle.exchange(writing | FRESH, std::memory_order_acq_rel);
+	writing = previous & ~FRESH;
+}
+
+template <class T>
+bool TripleBuffer<T>::acquire() {
+	if (!(middle.load(std::memory_order_acquire) & FRESH)) return false;
+	unsigned int previous = middle.exchange(reading, std::memory_order_acq_rel);
+	reading = previous & ~FRESH;
+	return true;
+}
+
+template <class T>
+void EventQueue<T>::push(const T& event) {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.push_back(event);
+}
+
+template <class T>
+void EventQueue<T>::drain(std::vector<T>& events) {
+	std::lock_guard<std::mutex> lock(mutex);
+	events.insert(events.end(), pending.begin(), pending.end());
+	pending.clear();
+}
+
+FixedStepThread::FixedStepThread(double _timestep, const std::function<void(double)>& _step, const std::function<void()>& _publish,
+	unsigned int _maxSteps) :
+	running(false), step(_step), publish(_publish), timestep(_timestep), maxSteps(_maxSteps), steps(0), droppedSteps(0) {}
+
+FixedStepThread::~FixedStepThread() {
+	stop();
+}
+
+void FixedStepThread::start() {
+	if (running) return;
+	running = true;
+	thread = std::thread(&FixedStepThread::loop, this);
+}
+
+void FixedStepThread::stop() {
+	running = false;
+	if (thread.joinable()) thread.join();
+}
+
+void FixedStepThread::loop() {
+	typedef std::chrono::steady_clock clock;
+	const clock::duration tick = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(timestep));
+	clock::time_point next = clock::now();
+	while (running) {
+		unsigned int count = 0;
+		clock::time_point now = clock::now();
+		while (next <= now && count < maxSteps) {
+			step(timestep);
+			next += tick;
+			count++;
+		}
+		if (next <= now) {
+			// 追不上时放弃积压的步数
+			droppedSteps += (unsigned long long)((now - next) / tick) + 1;
+			next = now + tick;
+		}
+		steps += count;
+		if (count > 0) publish();
+		std::this_thread::sleep_until(next);
+	}
+}
+
+#endif
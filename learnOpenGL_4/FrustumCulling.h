@@ -0,0 +1,208 @@
+#ifndef FRUSTUMCULLING_H
+#define FRUSTUMCULLING_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+
+#include "Shader_s.h"
+#include "TransformBatch.h"
+#include <LearnOpenGL/model.h>
+
+// 包围体：AABB 与以其中心为球心的包围球，球半径取到各顶点的最大距离，通常比半对角线更紧
+struct boundingVolume {
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 center;
+	float radius;
+};
+
+// 视锥六个平面 (n, d)，n 指向视锥内部且已归一化，点 p 在内侧当 dot(n, p) + d >= 0
+struct frustumPlanes {
+	glm::vec4 planes[6];
+};
+
+// 由网格顶点计算局部空间包围体，加载 Model 后对每个网格调用一次
+boundingVolume computeMeshBounds(const Mesh& mesh);
+std::vector<boundingVolume> computeModelBounds(const Model& model);
+// 合并两个包围体，球半径取合并后 AABB 的半对角线
+boundingVolume mergeBounds(const boundingVolume& a, const boundingVolume& b);
+// 整个 Model 的包围体，bounds 为空时返回原点处的空包围体
+boundingVolume mergeBounds(const std::vector<boundingVolume>& bounds);
+// 变换到世界空间：AABB 取变换后的外接盒，球半径乘以最大缩放
+boundingVolume transformBounds(const boundingVolume& bounds, const glm::mat4& world);
+// 从 projection * view 提取平面（Gribb-Hartmann）
+frustumPlanes extractFrustumPlanes(const glm::mat4& viewProjection);
+
+// 批量视锥剔除：世界空间包围体按分量分开存放，每次迭代测试 8 个
+// 每个平面上取 AABB 投影半径与球半径中较小者，两者都是保守的，取小值剔除得更多
+class FrustumCuller {
+private:
+	std::vector<float> cx, cy, cz;	// 中心
+	std::vector<float> ex, ey, ez;	// AABB 半边长
+	std::vector<float> radii;
+	std::vector<unsigned char> visibility;
+
+	template <class L>
+	void cullLanes(const frustumPlanes& frustum, unsigned int first, float* distances) const;
+public:
+	// 最近一次 cull() 的结果
+	unsigned int drawn;
+	unsigned int culled;
+
+	FrustumCuller() : drawn(0), culled(0) {}
+
+	void clear();
+	// 加入一个世界空间包围体，返回其下标
+	unsigned int add(const boundingVolume& worldBounds);
+	void cull(const frustumPlanes& frustum);
+	bool visible(unsigned int index) const { return visibility[index] != 0; }
+	unsigned int size() const { return (unsigned int)cx.size(); }
+};
+
+boundingVolume computeMeshBounds(const Mesh& mesh) {
+	boundingVolume bounds;
+	if (mesh.vertices.empty()) {
+		bounds.min = bounds.max = bounds.center = glm::vec3(0.f);
+		bounds.radius = 0.f;
+		return bounds;
+	}
+	bounds.min = glm::vec3(FLT_MAX);
+	bounds.max = glm::vec3(-FLT_MAX);
+	for (const Vertex& vertex : mesh.vertices) {
+		bounds.min = glm::min(bounds.min, vertex.Position);
+		bounds.max = glm::max(bounds.max, vertex.Position);
+	}
+	bounds.center = (bounds.min + bounds.max) * .5f;
+	float radius2 = 0.f;
+	for (const Vertex& vertex : mesh.vertices) {
+		glm::vec3 d = vertex.Position - bounds.center;
+		radius2 = std::fmax(radius2, glm::dot(d, d));
+	}
+	bounds.radius = std::sqrt(radius2);
+	return bounds;
+}
+
+std::vector<boundingVolume> computeModelBounds(const Model& model) {
+	std::vector<boundingVolume> bounds;
+	bounds.reserve(model.meshes.size());
+	for (const Mesh& mesh : model.meshes)
+		bounds.push_back(computeMeshBounds(mesh));
+	return bounds;
+}
+
+boundingVolume mergeBounds(const boundingVolume& a, const boundingVolume& b) {
+	boundingVolume bounds;
+	bounds.min = glm::min(a.min, b.min);
+	bounds.max = glm::max(a.max, b.max);
+	bounds.center = (bounds.min + bounds.max) * .5f;
+	bounds.radius = glm::length(bounds.max - bounds.center);
+	return bounds;
+}
+
+boundingVolume mergeBounds(const std::vector<boundingVolume>& bounds) {
+	if (bounds.empty()) {
+		boundingVolume empty;
+		empty.min = empty.max = empty.center = glm::vec3(0.f);
+		empty.radius = 0.f;
+		return empty;
+	}
+	boundingVolume result = bounds[0];
+	for (unsigned int i = 1; i < bounds.size(); i++)
+		result = mergeBounds(result, bounds[i]);
+	return result;
+}
+
+boundingVolume transformBounds(const boundingVolume& bounds, const glm::mat4& world) {
+	glm::vec3 center = glm::vec3(world * glm::vec4(bounds.center, 1.f));
+	glm::vec3 extent = (bounds.max - bounds.min) * .5f;
+	// 外接盒半边长 = |M3x3| * extent
+	glm::vec3 worldExtent(0.f);
+	for (int c = 0; c < 3; c++)
+		worldExtent += glm::abs(glm::vec3(world[c])) * extent[c];
+	float scale = std::fmax(glm::length(glm::vec3(world[0])), std::fmax(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+
+	boundingVolume result;
+	result.center = center;
+	result.min = center - worldExtent;
+	result.max = center + worldExtent;
+	result.radius = bounds.radius * scale;
+	return result;
+}
+
+frustumPlanes extractFrustumPlanes(const glm::mat4& m) {
+	// 行 i 为 (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	frustumPlanes frustum;
+	frustum.planes[0] = rows[3] + rows[0];	// left
+	frustum.planes[1] = rows[3] - rows[0];	// right
+	frustum.planes[2] = rows[3] + rows[1];	// bottom
+	frustum.planes[3] = rows[3] - rows[1];	// top
+	frustum.planes[4] = rows[3] + rows[2];	// near
+	frustum.planes[5] = rows[3] - rows[2];	// far
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+void FrustumCuller::clear() {
+	cx.clear(); cy.clear(); cz.clear();
+	ex.clear(); ey.clear(); ez.clear();
+	radii.clear();
+	visibility.clear();
+}
+
+unsigned int FrustumCuller::add(const boundingVolume& worldBounds) {
+	glm::vec3 extent = (worldBounds.max - worldBounds.min) * .5f;
+	cx.push_back(worldBounds.center.x); cy.push_back(worldBounds.center.y); cz.push_back(worldBounds.center.z);
+	ex.push_back(extent.x); ey.push_back(extent.y); ez.push_back(extent.z);
+	radii.push_back(worldBounds.radius);
+	return (unsigned int)cx.size() - 1;
+}
+
+// distances 为各包围体到最靠外平面的有符号距离（已加上半径），小于 0 即完全在某个平面之外
+template <class L>
+void FrustumCuller::cullLanes(const frustumPlanes& frustum, unsigned int first, float* distances) const {
+	typedef typename L::type V;
+	V x = L::load(&cx[first]), y = L::load(&cy[first]), z = L::load(&cz[first]);
+	V hx = L::load(&ex[first]), hy = L::load(&ey[first]), hz = L::load(&ez[first]);
+	V r = L::load(&radii[first]);
+	V nearest = L::set1(FLT_MAX);
+	for (const glm::vec4& plane : frustum.planes) {
+		V distance = L::add(L::add(L::mul(L::set1(plane.x), x), L::mul(L::set1(plane.y), y)),
+			L::add(L::mul(L::set1(plane.z), z), L::set1(plane.w)));
+		V boxRadius = L::add(L::add(L::mul(L::set1(std::fabs(plane.x)), hx), L::mul(L::set1(std::fabs(plane.y)), hy)),
+			L::mul(L::set1(std::fabs(plane.z)), hz));
+		nearest = L::minimum(nearest, L::add(distance, L::minimum(boxRadius, r)));
+	}
+	L::store(distances, nearest);
+}
+
+void FrustumCuller::cull(const frustumPlanes& frustum) {
+	unsigned int count = size();
+	visibility.assign(count, 0);
+	drawn = 0;
+	float distances[8];
+	unsigned int i = 0;
+	// 每次 8 个：AVX 一条通道，SSE 两条
+	for (; i + 8 <= count; i += 8) {
+		for (unsigned int lane = 0; lane < 8; lane += simdLane::width)
+			cullLanes<simdLane>(frustum, i + lane, distances + lane);
+		for (unsigned int k = 0; k < 8; k++) {
+			visibility[i + k] = distances[k] >= 0.f;
+			drawn += visibility[i + k];
+		}
+	}
+	for (; i < count; i++) {
+		cullLanes<scalarLane>(frustum, i, distances);
+		visibility[i] = distances[0] >= 0.f;
+		drawn += visibility[i];
+	}
+	culled = count - drawn;
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef GLEXTENSION_H
+#define GLEXTENSION_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad 只生成了 3.3 core，没有扩展
+// 这里在运行时按扩展名（或更高的上下文版本）手动取函数指针，取不到时各功能走回退路径
+
+// ARB_get_program_binary / GL 4.1
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// KHR_parallel_shader_compile
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// ARB_buffer_storage / GL 4.4
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+// ARB_separate_shader_objects / GL 4.1
+#ifndef GL_PROGRAM_SEPARABLE
+#define GL_PROGRAM_SEPARABLE 0x8258
+#endif
+#ifndef GL_VERTEX_SHADER_BIT
+#define GL_VERTEX_SHADER_BIT 0x00000001
+#endif
+#ifndef GL_FRAGMENT_SHADER_BIT
+#define GL_FRAGMENT_SHADER_BIT 0x00000002
+#endif
+#ifndef GL_GEOMETRY_SHADER_BIT
+#define GL_GEOMETRY_SHADER_BIT 0x00000004
+#endif
+
+// ARB_draw_indirect + ARB_multi_draw_indirect / GL 4.3
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef void (APIENTRYP PFNGLEXTGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLEXTPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLEXTPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLEXTMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+typedef void (APIENTRYP PFNGLEXTBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP PFNGLEXTGENPROGRAMPIPELINESPROC)(GLsizei n, GLuint* pipelines);
+typedef void (APIENTRYP PFNGLEXTDELETEPROGRAMPIPELINESPROC)(GLsizei n, const GLuint* pipelines);
+typedef void (APIENTRYP PFNGLEXTBINDPROGRAMPIPELINEPROC)(GLuint pipeline);
+typedef void (APIENTRYP PFNGLEXTUSEPROGRAMSTAGESPROC)(GLuint pipeline, GLbitfield stages, GLuint program);
+typedef void (APIENTRYP PFNGLEXTACTIVESHADERPROGRAMPROC)(GLuint pipeline, GLuint program);
+typedef void (APIENTRYP PFNGLEXTVALIDATEPROGRAMPIPELINEPROC)(GLuint pipeline);
+typedef void (APIENTRYP PFNGLEXTGETPROGRAMPIPELINEIVPROC)(GLuint pipeline, GLenum pname, GLint* params);
+typedef void (APIENTRYP PFNGLEXTGETPROGRAMPIPELINEINFOLOGPROC)(GLuint pipeline, GLsizei bufSize, GLsizei* length, GLchar* infoLog);
+typedef void (APIENTRYP PFNGLEXTMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+struct GLExtension {
+	// 程序二进制缓存
+	bool programBinary;
+	PFNGLEXTGETPROGRAMBINARYPROC GetProgramBinary;
+	PFNGLEXTPROGRAMBINARYPROC ProgramBinary;
+	PFNGLEXTPROGRAMPARAMETERIPROC ProgramParameteri;
+	// 并行编译，可以不阻塞地查询 GL_COMPLETION_STATUS_KHR
+	bool parallelShaderCompile;
+	PFNGLEXTMAXSHADERCOMPILERTHREADSPROC MaxShaderCompilerThreads;
+	// 不可变存储，可持久映射
+	bool bufferStorage;
+	PFNGLEXTBUFFERSTORAGEPROC BufferStorage;
+	// 可分离程序与程序管线，各阶段可以来自不同的程序
+	bool separateShaderObjects;
+	PFNGLEXTGENPROGRAMPIPELINESPROC GenProgramPipelines;
+	PFNGLEXTDELETEPROGRAMPIPELINESPROC DeleteProgramPipelines;
+	PFNGLEXTBINDPROGRAMPIPELINEPROC BindProgramPipeline;
+	PFNGLEXTUSEPROGRAMSTAGESPROC UseProgramStages;
+	PFNGLEXTACTIVESHADERPROGRAMPROC ActiveShaderProgram;
+	PFNGLEXTVALIDATEPROGRAMPIPELINEPROC ValidateProgramPipeline;
+	PFNGLEXTGETPROGRAMPIPELINEIVPROC GetProgramPipelineiv;
+	PFNGLEXTGETPROGRAMPIPELINEINFOLOGPROC GetProgramPipelineInfoLog;
+	// 一次调用提交缓冲中的多条间接绘制命令，命令的 baseInstance 可用于传递逐绘制数据
+	bool multiDrawIndirect;
+	PFNGLEXTMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect;
+
+	GLExtension() { std::memset(this, 0, sizeof(GLExtension)); }
+};
+
+GLExtension glExt;
+
+// 上下文版本不低于 major.minor
+bool hasGLVersion(int major, int minor) {
+	return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+bool hasGLExtension(const char* name) {
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && std::strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+// 在 gladLoadGLLoader 之后调用
+void loadGLExtension(GLADloadproc load) {
+	glExt = GLExtension();
+
+	if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary")) {
+		glExt.GetProgramBinary = (PFNGLEXTGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+		glExt.ProgramBinary = (PFNGLEXTPROGRAMBINARYPROC)load("glProgramBinary");
+		glExt.ProgramParameteri = (PFNGLEXTPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+		// 驱动可能支持扩展但不提供任何二进制格式（例如关闭了着色器缓存的 Mesa）
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		glExt.programBinary = glExt.GetProgramBinary && glExt.ProgramBinary && glExt.ProgramParameteri && formats > 0;
+	}
+
+	if (hasGLExtension("GL_KHR_parallel_shader_compile") || hasGLExtension("GL_ARB_parallel_shader_compile")) {
+		glExt.MaxShaderCompilerThreads = (PFNGLEXTMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+		if (!glExt.MaxShaderCompilerThreads)
+			glExt.MaxShaderCompilerThreads = (PFNGLEXTMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+		glExt.parallelShaderCompile = glExt.MaxShaderCompilerThreads != NULL;
+		// 0xFFFFFFFF 表示由驱动决定线程数
+		if (glExt.parallelShaderCompile)
+			glExt.MaxShaderCompilerThreads(0xFFFFFFFFu);
+	}
+
+	if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage")) {
+		glExt.BufferStorage = (PFNGLEXTBUFFERSTORAGEPROC)load("glBufferStorage");
+		glExt.bufferStorage = glExt.BufferStorage != NULL;
+	}
+
+	if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_separate_shader_objects")) {
+		if (!glExt.ProgramParameteri)
+			glExt.ProgramParameteri = (PFNGLEXTPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+		glExt.GenProgramPipelines = (PFNGLEXTGENPROGRAMPIPELINESPROC)load("glGenProgramPipelines");
+		glExt.DeleteProgramPipelines = (PFNGLEXTDELETEPROGRAMPIPELINESPROC)load("glDeleteProgramPipelines");
+		glExt.BindProgramPipeline = (PFNGLEXTBINDPROGRAMPIPELINEPROC)load("glBindProgramPipeline");
+		glExt.UseProgramStages = (PFNGLEXTUSEPROGRAMSTAGESPROC)load("glUseProgramStages");
+		glExt.ActiveShaderProgram = (PFNGLEXTACTIVESHADERPROGRAMPROC)load("glActiveShaderProgram");
+		glExt.ValidateProgramPipeline = (PFNGLEXTVALIDATEPROGRAMPIPELINEPROC)load("glValidateProgramPipeline");
+		glExt.GetProgramPipelineiv = (PFNGLEXTGETPROGRAMPIPELINEIVPROC)load("glGetProgramPipelineiv");
+		glExt.GetProgramPipelineInfoLog = (PFNGLEXTGETPROGRAMPIPELINEINFOLOGPROC)load("glGetProgramPipelineInfoLog");
+		glExt.separateShaderObjects = glExt.ProgramParameteri && glExt.GenProgramPipelines && glExt.DeleteProgramPipelines &&
+			glExt.BindProgramPipeline && glExt.UseProgramStages && glExt.ActiveShaderProgram &&
+			glExt.ValidateProgramPipeline && glExt.GetProgramPipelineiv && glExt.GetProgramPipelineInfoLog;
+	}
+
+	// 命令里的 baseInstance 需要 ARB_base_instance，否则该字段必须为 0
+	if (hasGLVersion(4, 3) || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_draw_indirect") &&
+		hasGLExtension("GL_ARB_base_instance"))) {
+		glExt.MultiDrawElementsIndirect = (PFNGLEXTMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+		glExt.multiDrawIndirect = glExt.MultiDrawElementsIndirect != NULL;
+	}
+}
+
+#endif
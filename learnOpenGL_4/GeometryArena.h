@@ -0,0 +1,380 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <map>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+#include "GLExtension.h"
+#include "Shader_s.h"
+#include "MeshSimplifier.h"
+#include <LearnOpenGL/model.h>
+
+// 合并几何：多个 Model 的全部网格分配到共享的顶点/索引缓冲，只用一个 VAO
+// 每个网格的第一张漫反射纹理缩放后拷贝为纹理数组的一层
+// 逐绘制数据（层号、实例号）每次 submit() 写入一个实例属性流（location 7），命令的 baseInstance 即其在流中的下标
+// 有 multi draw indirect 时一次 glMultiDrawElementsIndirect 提交排队的全部网格；否则逐网格 glDrawElementsBaseVertex，
+// 逐绘制数据改用常量属性值
+// 实例：addInstance() 登记的矩阵写入缓冲纹理，INSTANCE_BUFFER 变体按实例号读取，同一个模型的多份拷贝一次提交
+// LOD：buildLods() 用 MeshSimplifier 为每个网格生成简化的索引，追加到同一个索引缓冲，各级共用网格的顶点与 baseVertex
+class GeometryArena {
+public:
+	static const unsigned int MAX_LODS = 4;
+private:
+	// 与 DrawElementsIndirectCommand 布局一致
+	struct drawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+	// 实例属性流中的一项
+	struct drawData {
+		GLint layer;
+		GLint instance;	// -1 表示使用 Object 块
+	};
+	struct meshLod {
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		float error;	// 模型空间中偏离原表面的距离
+	};
+	struct arenaMesh {
+		meshLod lods[MAX_LODS];	// lods[0] 为原网格
+		unsigned int lodCount;
+		unsigned int baseVertex;
+		int layer;	// 纹理数组层，-1 表示没有漫反射纹理
+	};
+
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<arenaMesh> meshes;
+	std::vector<unsigned int> layerTextures;	// 各层的源纹理
+	std::vector<drawCommand> commands;
+	std::vector<drawData> draws;
+	std::vector<glm::vec4> instanceTexels;	// 每个实例 8 个：模型矩阵与法线矩阵的各列
+	unsigned int layerSize;
+	unsigned int VBO, EBO, drawVBO;
+	unsigned int indirectBuffer, commandCapacity;
+	unsigned int instanceBuffer, instanceTexture, instanceCapacity;
+
+	// 层数超出上限时不建纹理数组并返回 false
+	bool buildTextureArray();
+public:
+	static const unsigned int DRAW_LOCATION = 7;
+	// 实例矩阵缓冲纹理占用的单元，与 DeferredShading、ClusteredLighting 的单元错开
+	static const unsigned int INSTANCE_UNIT = 15;
+
+	unsigned int VAO;
+	unsigned int textureArray;
+	// upload() 成功后为 true；纹理层数超过 GL_MAX_ARRAY_TEXTURE_LAYERS 时为 false，调用方须改用逐网格绘制
+	bool ready;
+	// 最近一次 submit() 的网格数、绘制调用数与三角形数
+	unsigned int meshCount;
+	unsigned int drawCalls;
+	unsigned int triangleCount;
+	// buildLods() 的耗时(ms)、处理的原始三角形数与生成的各级简化三角形总数
+	double lodBuildTime;
+	unsigned int lodSourceTriangles;
+	unsigned int lodSimplifiedTriangles;
+
+	// 纹理数组每层 layerSize x layerSize
+	GeometryArena(unsigned int _layerSize = 1024);
+	~GeometryArena();
+
+	// 追加一个 Model 的全部网格，返回其第一个网格在 arena 中的下标；全部加入后调用一次 upload()
+	unsigned int addModel(const Model& model);
+	// 为 [first, first + count) 的网格生成至多 MAX_LODS - 1 级简化，每级三角形数减半，须在 upload() 之前调用
+	void buildLods(unsigned int first, unsigned int count);
+	void upload();
+	unsigned int size() const { return (unsigned int)meshes.size(); }
+	unsigned int layerCount() const { return (unsigned int)layerTextures.size(); }
+
+	unsigned int lodCount(unsigned int mesh) const { return meshes[mesh].lodCount; }
+	unsigned int lodTriangles(unsigned int mesh, unsigned int lod) const { return meshes[mesh].lods[lod].indexCount / 3; }
+	// 投影误差不超过 maxPixelError 的最粗一级，pixelsPerUnit 为模型空间单位长度在该距离上的像素数
+	unsigned int selectLod(unsigned int mesh, float pixelsPerUnit, float maxPixelError) const;
+
+	// 登记一个实例到下一次 submit()，返回实例号
+	int addInstance(const glm::mat4& model, const glm::mat4& normal);
+	// 排队绘制 arena 中的第 mesh 个网格的第 lod 级，instance 为 addInstance() 的返回值，-1 时顶点着色器用 Object 块
+	void queue(unsigned int mesh, unsigned int lod = 0, int instance = -1);
+	// 绘制排队的网格并清空队列与实例，program 须为 MATERIAL_ARRAY 变体，采样器名为 materials；
+	// 有实例时顶点阶段须为 INSTANCE_BUFFER 变体，其 instances 采样器由调用方设为 INSTANCE_UNIT
+	void submit(Shader& program);
+};
+
+GeometryArena::GeometryArena(unsigned int _layerSize) :
+	layerSize(_layerSize), VBO(0), EBO(0), drawVBO(0), indirectBuffer(0), commandCapacity(0),
+	instanceBuffer(0), instanceTexture(0), instanceCapacity(0), VAO(0), textureArray(0), ready(false),
+	meshCount(0), drawCalls(0), triangleCount(0), lodBuildTime(0.0), lodSourceTriangles(0), lodSimplifiedTriangles(0) {}
+
+GeometryArena::~GeometryArena() {
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &drawVBO);
+	glDeleteBuffers(1, &indirectBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteTextures(1, &instanceTexture);
+	glDeleteTextures(1, &textureArray);
+}
+
+unsigned int GeometryArena::addModel(const Model& model) {
+	unsigned int first = (unsigned int)meshes.size();
+	std::map<unsigned int, int> layers;
+	for (unsigned int i = 0; i < layerTextures.size(); i++)
+		layers[layerTextures[i]] = (int)i;
+
+	for (const Mesh& mesh : model.meshes) {
+		arenaMesh range;
+		range.lods[0].firstIndex = (unsigned int)indices.size();
+		range.lods[0].indexCount = (unsigned int)mesh.indices.size();
+		range.lods[0].error = 0.f;
+		range.lodCount = 1;
+		range.baseVertex = (unsigned int)vertices.size();
+		range.layer = -1;
+		for (const Texture& texture : mesh.textures) {
+			if (texture.type != "texture_diffuse") continue;
+			auto it = layers.find(texture.id);
+			if (it == layers.end()) {
+				it = layers.insert(std::make_pair(texture.id, (int)layerTextures.size())).first;
+				layerTextures.push_back(texture.id);
+			}
+			range.layer = it->second;
+			break;
+		}
+		// 索引保持网格内的相对值，绘制时由 baseVertex 偏移
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+		meshes.push_back(range);
+	}
+	return first;
+}
+
+void GeometryArena::buildLods(unsigned int first, unsigned int count) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	lodSourceTriangles = 0;
+	lodSimplifiedTriangles = 0;
+	std::vector<Vertex> meshVertices;
+	std::vector<unsigned int> meshIndices, lodIndices;
+	for (unsigned int i = first; i < first + count && i < meshes.size(); i++) {
+		arenaMesh& mesh = meshes[i];
+		const meshLod& source = mesh.lods[0];
+		// 顶点范围：下一个网格的 baseVertex 之前，或到末尾
+		unsigned int vertexEnd = i + 1 < meshes.size() ? meshes[i + 1].baseVertex : (unsigned int)vertices.size();
+		meshVertices.assign(vertices.begin() + mesh.baseVertex, vertices.begin() + vertexEnd);
+		meshIndices.assign(indices.begin() + source.firstIndex, indices.begin() + source.firstIndex + source.indexCount);
+		MeshSimplifier simplifier(meshVertices, meshIndices);
+		unsigned int target = simplifier.triangleCount();
+		lodSourceTriangles += target;
+		mesh.lodCount = 1;
+		while (mesh.lodCount < MAX_LODS) {
+			// 太小的网格不再简化，简化不动（全是边界或接缝）时也停止
+			target /= 2;
+			if (target < 32) break;
+			unsigned int before = simplifier.triangleCount();
+			simplifier.simplify(target);
+			if (simplifier.triangleCount() * 10 > before * 9) break;
+			simplifier.result(lodIndices);
+			meshLod& lod = mesh.lods[mesh.lodCount++];
+			lod.firstIndex = (unsigned int)indices.size();
+			lod.indexCount = (unsigned int)lodIndices.size();
+			lod.error = simplifier.error;
+			indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+			lodSimplifiedTriangles += lod.indexCount / 3;
+		}
+	}
+	lodBuildTime = elapsedMilliseconds(start);
+}
+
+unsigned int GeometryArena::selectLod(unsigned int mesh, float pixelsPerUnit, float maxPixelError) const {
+	const arenaMesh& range = meshes[mesh];
+	unsigned int lod = 0;
+	while (lod + 1 < range.lodCount && range.lods[lod + 1].error * pixelsPerUnit <= maxPixelError)
+		lod++;
+	return lod;
+}
+
+void GeometryArena::upload() {
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	glGenBuffers(1, &drawVBO);
+	glGenBuffers(1, &instanceBuffer);
+	glGenTextures(1, &instanceTexture);
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	// 与 Mesh::setupMesh 相同的属性位置
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	glEnableVertexAttribArray(5);
+	glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+
+	// 逐绘制数据，除数为 1，第 baseInstance 个元素即该命令的数据；存储在 submit() 时分配
+	glBindBuffer(GL_ARRAY_BUFFER, drawVBO);
+	glVertexAttribIPointer(DRAW_LOCATION, 2, GL_INT, sizeof(drawData), (void*)0);
+	glVertexAttribDivisor(DRAW_LOCATION, 1);
+	if (glExt.multiDrawIndirect)
+		glEnableVertexAttribArray(DRAW_LOCATION);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	if (glExt.multiDrawIndirect)
+		glGenBuffers(1, &indirectBuffer);
+	ready = buildTextureArray();
+
+	// 数据已在显存
+	std::vector<Vertex>().swap(vertices);
+	std::vector<unsigned int>().swap(indices);
+}
+
+// 各源纹理用 glBlitFramebuffer 线性缩放到同一尺寸的层中，再生成整个数组的 mipmap
+bool GeometryArena::buildTextureArray() {
+	if (layerTextures.empty()) return true;
+	int maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	// 超出的层会被采样器钳到最后一层，用错别的网格的纹理，不如整个 arena 不用
+	if ((int)layerTextures.size() > maxLayers) {
+		std::cout << "ERROR::GEOMETRYARENA::TOO_MANY_LAYERS " << layerTextures.size() << " > " << maxLayers << std::endl;
+		return false;
+	}
+
+	glGenTextures(1, &textureArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layerSize, layerSize, (GLsizei)layerTextures.size(), 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, NULL);
+
+	int previousRead = 0, previousDraw = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+	unsigned int framebuffers[2];
+	glGenFramebuffers(2, framebuffers);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+	for (unsigned int layer = 0; layer < layerTextures.size(); layer++) {
+		int width = 0, height = 0;
+		glBindTexture(GL_TEXTURE_2D, layerTextures[layer]);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layerTextures[layer], 0);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureArray, 0, layer);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, layerSize, layerSize, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+	glDeleteFramebuffers(2, framebuffers);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return true;
+}
+
+int GeometryArena::addInstance(const glm::mat4& model, const glm::mat4& normal) {
+	for (int i = 0; i < 4; i++)
+		instanceTexels.push_back(model[i]);
+	for (int i = 0; i < 4; i++)
+		instanceTexels.push_back(normal[i]);
+	return (int)(instanceTexels.size() / 8) - 1;
+}
+
+void GeometryArena::queue(unsigned int mesh, unsigned int lod, int instance) {
+	const arenaMesh& range = meshes[mesh];
+	drawCommand command;
+	command.count = range.lods[lod].indexCount;
+	command.instanceCount = 1;
+	command.firstIndex = range.lods[lod].firstIndex;
+	command.baseVertex = (GLint)range.baseVertex;
+	command.baseInstance = (GLuint)draws.size();
+	commands.push_back(command);
+	drawData draw;
+	draw.layer = range.layer;
+	draw.instance = instance;
+	draws.push_back(draw);
+}
+
+void GeometryArena::submit(Shader& program) {
+	meshCount = (unsigned int)commands.size();
+	drawCalls = 0;
+	triangleCount = 0;
+	if (commands.empty()) return;
+	for (const drawCommand& command : commands)
+		triangleCount += command.count / 3;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	program.setInt("materials"_u, 0);
+	if (!instanceTexels.empty()) {
+		// 孤立旧存储后整体写入，与 ClusteredLighting::upload 相同
+		unsigned int count = (unsigned int)instanceTexels.size();
+		glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+		bool grown = count > instanceCapacity;
+		if (grown) instanceCapacity = instanceCapacity * 2 > count ? instanceCapacity * 2 : count;
+		glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)instanceCapacity * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)count * sizeof(glm::vec4), instanceTexels.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0 + INSTANCE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+		if (grown) glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	glBindVertexArray(VAO);
+	if (glExt.multiDrawIndirect) {
+		// 命令与逐绘制数据一一对应，都孤立旧存储后整体写入，与 InstanceBatch 相同
+		if (commands.size() > commandCapacity)
+			commandCapacity = commandCapacity * 2 > commands.size() ? commandCapacity * 2 : (unsigned int)commands.size();
+		glBindBuffer(GL_ARRAY_BUFFER, drawVBO);
+		glBufferData(GL_ARRAY_BUFFER, commandCapacity * sizeof(drawData), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, draws.size() * sizeof(drawData), draws.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(drawCommand), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(drawCommand), commands.data());
+		glExt.MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)commands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		drawCalls = 1;
+	}
+	else {
+		for (const drawCommand& command : commands) {
+			const drawData& draw = draws[command.baseInstance];
+			glVertexAttribI2i(DRAW_LOCATION, draw.layer, draw.instance);
+			glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)command.count, GL_UNSIGNED_INT,
+				(void*)(command.firstIndex * sizeof(unsigned int)), command.baseVertex);
+			drawCalls++;
+		}
+	}
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	commands.clear();
+	draws.clear();
+	instanceTexels.clear();
+}
+
+#endif
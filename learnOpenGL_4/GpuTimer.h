@@ -0,0 +1,53 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+// 一段 GPU 工作的耗时：GL_TIME_ELAPSED 查询按帧交替，begin() 读上一帧的结果，从不等待 GPU
+// TIME_ELAPSED 查询不能嵌套，同一时刻只能有一个计时段
+class GpuTimer {
+private:
+	unsigned int queries[2];
+	bool issued[2];
+	unsigned int frame;
+public:
+	// 上一帧的耗时(ms)
+	double time;
+
+	GpuTimer();
+	~GpuTimer();
+
+	void begin();
+	void end();
+};
+
+GpuTimer::GpuTimer() : frame(0), time(0.0) {
+	glGenQueries(2, queries);
+	issued[0] = issued[1] = false;
+}
+
+GpuTimer::~GpuTimer() {
+	glDeleteQueries(2, queries);
+}
+
+void GpuTimer::begin() {
+	frame++;
+	unsigned int current = frame & 1, previous = current ^ 1;
+	if (issued[previous]) {
+		int available = GL_FALSE;
+		glGetQueryObjectiv(queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(queries[previous], GL_QUERY_RESULT, &elapsed);
+			time = elapsed / 1e6;
+		}
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+	issued[current] = true;
+}
+
+void GpuTimer::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+#endif
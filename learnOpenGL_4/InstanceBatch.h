@@ -0,0 +1,107 @@
+#ifndef INSTANCEBATCH_H
+#define INSTANCEBATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Shader_s.h"
+#include "RenderQueue.h"
+#include <LearnOpenGL/model.h>
+
+// 逐实例数据，对应顶点着色器 INSTANCED 变体里 location 8 起的两个 mat4 属性
+struct instanceData {
+	glm::mat4 model;
+	glm::mat4 nrmMat;
+};
+
+// 同一个 Model 的多份拷贝：逐实例矩阵放在一个 VBO 里，属性除数为 1
+// 每个网格一次 glDrawElementsInstanced，绘制调用数与实例数无关
+// 实例属性直接挂在各网格自己的 VAO 上（普通程序不读取这些位置），因此一个 Model 只能对应一个批次
+class InstanceBatch {
+private:
+	Model* model;
+	std::vector<instanceData> instances;
+	unsigned int capacity;	// VBO 当前可容纳的实例数
+	bool dirty;
+
+	void upload();
+public:
+	static const unsigned int ATTRIB_LOCATION = 8;
+
+	unsigned int VBO;
+	// 最近一次 draw() 的绘制调用数
+	unsigned int drawCalls;
+
+	InstanceBatch(Model& _model);
+	~InstanceBatch();
+
+	void clear();
+	void add(const glm::mat4& world, const glm::mat4& normal);
+	unsigned int size() const { return (unsigned int)instances.size(); }
+
+	// program 须为 INSTANCED 变体（或管线中已换上实例化的顶点阶段），有改动时先上传实例数据
+	void draw(Shader& program);
+};
+
+InstanceBatch::InstanceBatch(Model& _model) : model(&_model), capacity(0), dirty(false), drawCalls(0) {
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	// 两个 mat4 共占 8 个属性位置，每个位置一列
+	for (const Mesh& mesh : model->meshes) {
+		glBindVertexArray(mesh.VAO);
+		for (unsigned int i = 0; i < 8; i++) {
+			glEnableVertexAttribArray(ATTRIB_LOCATION + i);
+			glVertexAttribPointer(ATTRIB_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(instanceData),
+				(void*)(sizeof(glm::vec4) * i));
+			glVertexAttribDivisor(ATTRIB_LOCATION + i, 1);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+InstanceBatch::~InstanceBatch() {
+	glDeleteBuffers(1, &VBO);
+}
+
+void InstanceBatch::clear() {
+	instances.clear();
+	dirty = true;
+}
+
+void InstanceBatch::add(const glm::mat4& world, const glm::mat4& normal) {
+	instanceData instance;
+	instance.model = world;
+	instance.nrmMat = normal;
+	instances.push_back(instance);
+	dirty = true;
+}
+
+// 容量不够时按两倍扩容；每次都先孤立旧存储再整体写入，避免等待上一帧的绘制
+void InstanceBatch::upload() {
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	GLsizeiptr size = (GLsizeiptr)(instances.size() * sizeof(instanceData));
+	if (instances.size() > capacity)
+		capacity = capacity * 2 > instances.size() ? capacity * 2 : (unsigned int)instances.size();
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(capacity * sizeof(instanceData)), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	dirty = false;
+}
+
+void InstanceBatch::draw(Shader& program) {
+	drawCalls = 0;
+	if (instances.empty()) return;
+	if (dirty) upload();
+	for (const Mesh& mesh : model->meshes) {
+		RenderQueue::bindTextures(program, mesh);
+		glBindVertexArray(mesh.VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, 0, (GLsizei)instances.size());
+		drawCalls++;
+	}
+	glBindVertexArray(0);
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+#include <LearnOpenGL/mesh.h>
+
+// 二次误差度量（QEM）网格简化，用于生成 LOD
+// 只做半边坍缩：一个顶点并到相邻的已有顶点上，不产生新顶点，各级结果因此共用原网格的顶点缓冲，只是索引不同
+// 位置相同的顶点（纹理接缝两侧的拷贝）按同一个位置处理；坍缩时它的每份拷贝都须能沿被坍缩的边对应到目标的一份拷贝，
+// 否则拒绝，接缝只会沿自身收缩而不会被撕开
+// 边界边另加一个垂直于三角形的平面，边界顶点只能沿边界坍缩，轮廓不会内缩
+class MeshSimplifier {
+private:
+	// 对称 4x4 矩阵的上三角
+	struct quadric {
+		double m[10];
+		double area;	// 面平面的面积权重之和，误差按它归一化为距离
+
+		quadric() : area(0.0) { std::fill(m, m + 10, 0.0); }
+		void addPlane(const glm::dvec3& normal, double d, double weight);
+		void operator+=(const quadric& other);
+		double evaluate(const glm::vec3& p) const;
+	};
+	struct collapse {
+		double cost;
+		unsigned int from, to;
+		unsigned int fromVersion, toVersion;
+
+		bool operator<(const collapse& other) const { return cost > other.cost; }
+	};
+
+	const std::vector<Vertex>& vertices;
+	std::vector<unsigned int> triangles;	// 原顶点下标，3 个一组
+	std::vector<bool> removed;
+	unsigned int liveTriangles;
+	// 位置类：位置相同的顶点归为一类，拓扑与误差都以类为单位
+	std::vector<unsigned int> classOf;
+	std::vector<glm::vec3> positions;
+	std::vector<std::vector<unsigned int> > classTriangles;	// 含已删除的三角形，使用时跳过
+	std::vector<quadric> quadrics;
+	std::vector<bool> alive;
+	std::vector<bool> border;
+	std::vector<unsigned int> versions;
+	std::priority_queue<collapse> heap;
+	// 坍缩检查用的临时数据
+	std::vector<unsigned int> wedgeMap;
+	std::vector<unsigned int> touched;
+
+	void neighbours(unsigned int cls, std::vector<unsigned int>& result) const;
+	void pushEdges(unsigned int cls);
+	double cost(unsigned int from, unsigned int to) const;
+	bool valid(unsigned int from, unsigned int to);
+	void apply(unsigned int from, unsigned int to, double collapseCost);
+public:
+	// 已执行坍缩的最大误差，模型空间中到原表面的均方根距离
+	float error;
+
+	MeshSimplifier(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& indices);
+
+	// 坍缩到不多于 targetTriangles 个三角形，或再也找不到合法的坍缩；可多次调用，目标逐次减小
+	void simplify(unsigned int targetTriangles);
+	unsigned int triangleCount() const { return liveTriangles; }
+	// 当前结果的索引，引用原顶点
+	void result(std::vector<unsigned int>& indices) const;
+};
+
+void MeshSimplifier::quadric::addPlane(const glm::dvec3& normal, double d, double weight) {
+	double a = normal.x, b = normal.y, c = normal.z;
+	m[0] += weight * a * a; m[1] += weight * a * b; m[2] += weight * a * c; m[3] += weight * a * d;
+	m[4] += weight * b * b; m[5] += weight * b * c; m[6] += weight * b * d;
+	m[7] += weight * c * c; m[8] += weight * c * d;
+	m[9] += weight * d * d;
+}
+
+void MeshSimplifier::quadric::operator+=(const quadric& other) {
+	for (int i = 0; i < 10; i++) m[i] += other.m[i];
+	area += other.area;
+}
+
+double MeshSimplifier::quadric::evaluate(const glm::vec3& p) const {
+	double x = p.x, y = p.y, z = p.z;
+	return m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x +
+		m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y +
+		m[7] * z * z + 2.0 * m[8] * z + m[9];
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& indices) :
+	vertices(_vertices), triangles(indices), liveTriangles(0), error(0.f) {
+	triangles.resize(triangles.size() / 3 * 3);
+	removed.assign(triangles.size() / 3, false);
+
+	// 按位置排序后相邻的相等位置归为一类
+	std::vector<unsigned int> order(vertices.size());
+	for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		const glm::vec3& p = vertices[a].Position;
+		const glm::vec3& q = vertices[b].Position;
+		if (p.x != q.x) return p.x < q.x;
+		if (p.y != q.y) return p.y < q.y;
+		return p.z < q.z;
+	});
+	classOf.assign(vertices.size(), 0);
+	for (unsigned int i = 0; i < order.size(); i++) {
+		if (i == 0 || vertices[order[i]].Position != positions.back()) positions.push_back(vertices[order[i]].Position);
+		classOf[order[i]] = (unsigned int)positions.size() - 1;
+	}
+	unsigned int classes = (unsigned int)positions.size();
+
+	classTriangles.resize(classes);
+	quadrics.resize(classes);
+	alive.assign(classes, true);
+	border.assign(classes, false);
+	versions.assign(classes, 0);
+	wedgeMap.assign(vertices.size(), UINT_MAX);
+
+	// 面的平面，按面积加权
+	for (unsigned int t = 0; t < removed.size(); t++) {
+		unsigned int c[3] = { classOf[triangles[t * 3]], classOf[triangles[t * 3 + 1]], classOf[triangles[t * 3 + 2]] };
+		if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2]) {
+			removed[t] = true;
+			continue;
+		}
+		liveTriangles++;
+		glm::dvec3 p0(positions[c[0]]), p1(positions[c[1]]), p2(positions[c[2]]);
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(normal);
+		double area = length * .5;
+		if (length > 0.0) normal /= length;
+		for (int k = 0; k < 3; k++) {
+			classTriangles[c[k]].push_back(t);
+			quadrics[c[k]].addPlane(normal, -glm::dot(normal, p0), area);
+			quadrics[c[k]].area += area;
+		}
+	}
+
+	// 边界边：只属于一个三角形的边，按类统计
+	for (unsigned int a = 0; a < classes; a++) {
+		for (unsigned int t : classTriangles[a]) {
+			if (removed[t]) continue;
+			for (int k = 0; k < 3; k++) {
+				unsigned int b = classOf[triangles[t * 3 + k]];
+				if (b <= a) continue;
+				unsigned int shared = 0;
+				for (unsigned int s : classTriangles[a]) {
+					if (removed[s]) continue;
+					for (int j = 0; j < 3; j++)
+						if (classOf[triangles[s * 3 + j]] == b) shared++;
+				}
+				if (shared != 1) continue;
+				border[a] = border[b] = true;
+				// 过边且垂直于三角形的平面，权重取边长平方，使边界上的坍缩代价与面上的相当
+				unsigned int opposite = classOf[triangles[t * 3 + (k + 1) % 3]] == a ?
+					classOf[triangles[t * 3 + (k + 2) % 3]] : classOf[triangles[t * 3 + (k + 1) % 3]];
+				glm::dvec3 pa(positions[a]), pb(positions[b]), po(positions[opposite]);
+				glm::dvec3 edge = pb - pa;
+				glm::dvec3 faceNormal = glm::cross(edge, po - pa);
+				glm::dvec3 normal = glm::cross(edge, faceNormal);
+				double length = glm::length(normal);
+				if (length <= 0.0) continue;
+				normal /= length;
+				double weight = glm::dot(edge, edge) * 10.0;
+				quadrics[a].addPlane(normal, -glm::dot(normal, pa), weight);
+				quadrics[b].addPlane(normal, -glm::dot(normal, pa), weight);
+			}
+		}
+	}
+
+	for (unsigned int a = 0; a < classes; a++)
+		if (!classTriangles[a].empty()) pushEdges(a);
+}
+
+void MeshSimplifier::neighbours(unsigned int cls, std::vector<unsigned int>& result) const {
+	result.clear();
+	for (unsigned int t : classTriangles[cls]) {
+		if (removed[t]) continue;
+		for (int k = 0; k < 3; k++) {
+			unsigned int other = classOf[triangles[t * 3 + k]];
+			if (other != cls && std::find(result.begin(), result.end(), other) == result.end())
+				result.push_back(other);
+		}
+	}
+}
+
+void MeshSimplifier::pushEdges(unsigned int cls) {
+	std::vector<unsigned int> adjacent;
+	neighbours(cls, adjacent);
+	for (unsigned int other : adjacent) {
+		collapse entry;
+		entry.cost = cost(cls, other);
+		entry.from = cls;
+		entry.to = other;
+		entry.fromVersion = versions[cls];
+		entry.toVersion = versions[other];
+		heap.push(entry);
+		entry.cost = cost(other, cls);
+		entry.from = other;
+		entry.to = cls;
+		entry.fromVersion = versions[other];
+		entry.toVersion = versions[cls];
+		heap.push(entry);
+	}
+}
+
+double MeshSimplifier::cost(unsigned int from, unsigned int to) const {
+	quadric sum = quadrics[from];
+	sum += quadrics[to];
+	double value = sum.evaluate(positions[to]);
+	return (value > 0.0 ? value : 0.0) / (sum.area > 1e-12 ? sum.area : 1e-12);
+}
+
+bool MeshSimplifier::valid(unsigned int from, unsigned int to) {
+	// 共享的三角形数：1 为边界边，2 为流形内部的边
+	unsigned int shared = 0;
+	for (unsigned int t : classTriangles[from]) {
+		if (removed[t]) continue;
+		for (int k = 0; k < 3; k++)
+			if (classOf[triangles[t * 3 + k]] == to) shared++;
+	}
+	if (shared == 0 || shared > 2) return false;
+	if (border[from] && shared != 1) return false;
+
+	// 连接条件：两端的公共邻点只能是共享三角形的对顶点，否则坍缩后会出现重叠的面
+	std::vector<unsigned int> fromAdjacent, toAdjacent;
+	neighbours(from, fromAdjacent);
+	neighbours(to, toAdjacent);
+	unsigned int common = 0;
+	for (unsigned int v : fromAdjacent)
+		if (std::find(toAdjacent.begin(), toAdjacent.end(), v) != toAdjacent.end()) common++;
+	if (common != shared) return false;
+
+	// 每份拷贝沿共享三角形对应到目标的一份拷贝
+	bool result = true;
+	touched.clear();
+	for (unsigned int t : classTriangles[from]) {
+		if (removed[t]) continue;
+		unsigned int x = UINT_MAX, y = UINT_MAX;
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = triangles[t * 3 + k];
+			if (classOf[v] == from) x = v;
+			else if (classOf[v] == to) y = v;
+		}
+		if (y == UINT_MAX) continue;
+		if (wedgeMap[x] == UINT_MAX) {
+			wedgeMap[x] = y;
+			touched.push_back(x);
+		}
+		else if (wedgeMap[x] != y) result = false;
+	}
+	const glm::vec3& target = positions[to];
+	for (unsigned int t : classTriangles[from]) {
+		if (!result) break;
+		if (removed[t]) continue;
+		glm::vec3 p[3];
+		int corner = -1;
+		bool sharesEdge = false;
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = triangles[t * 3 + k];
+			p[k] = vertices[v].Position;
+			if (classOf[v] == from) {
+				corner = k;
+				// 没有对应的拷贝：它在接缝的另一侧，坍缩会撕开接缝
+				if (wedgeMap[v] == UINT_MAX) result = false;
+			}
+			else if (classOf[v] == to) sharesEdge = true;
+		}
+		if (sharesEdge || !result) continue;
+		// 翻转检查：移动后的法线不能反向或退化
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		p[corner] = target;
+		glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+		float afterLength = glm::length(after), beforeLength = glm::length(before);
+		if (afterLength <= 1e-12f * (beforeLength + 1e-12f) || glm::dot(before, after) <= .2f * beforeLength * afterLength)
+			result = false;
+	}
+	if (!result)
+		for (unsigned int x : touched) wedgeMap[x] = UINT_MAX;
+	return result;
+}
+
+void MeshSimplifier::apply(unsigned int from, unsigned int to, double collapseCost) {
+	for (unsigned int t : classTriangles[from]) {
+		if (removed[t]) continue;
+		bool sharesEdge = false;
+		for (int k = 0; k < 3; k++)
+			if (classOf[triangles[t * 3 + k]] == to) sharesEdge = true;
+		if (sharesEdge) {
+			removed[t] = true;
+			liveTriangles--;
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			unsigned int& v = triangles[t * 3 + k];
+			if (classOf[v] == from) v = wedgeMap[v];
+		}
+		classTriangles[to].push_back(t);
+	}
+	for (unsigned int x : touched) wedgeMap[x] = UINT_MAX;
+	// 去掉已删除的三角形，邻接表不会无限增长
+	std::vector<unsigned int>& list = classTriangles[to];
+	list.erase(std::remove_if(list.begin(), list.end(), [&](unsigned int t) { return removed[t]; }), list.end());
+	std::vector<unsigned int>().swap(classTriangles[from]);
+
+	quadrics[to] += quadrics[from];
+	alive[from] = false;
+	versions[to]++;
+	error = std::max(error, (float)std::sqrt(collapseCost));
+	pushEdges(to);
+}
+
+void MeshSimplifier::simplify(unsigned int targetTriangles) {
+	while (liveTriangles > targetTriangles && !heap.empty()) {
+		collapse entry = heap.top();
+		heap.pop();
+		if (!alive[entry.from] || !alive[entry.to]) continue;
+		if (entry.fromVersion != versions[entry.from] || entry.toVersion != versions[entry.to]) continue;
+		if (!valid(entry.from, entry.to)) continue;
+		apply(entry.from, entry.to, entry.cost);
+	}
+}
+
+void MeshSimplifier::result(std::vector<unsigned int>& indices) const {
+	indices.clear();
+	for (unsigned int t = 0; t < removed.size(); t++)
+		if (!removed[t])
+			indices.insert(indices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+}
+
+#endif
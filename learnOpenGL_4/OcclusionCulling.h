@@ -0,0 +1,203 @@
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <string>
+#include <vector>
+
+#include "Shader_s.h"
+#include "FrustumCulling.h"
+
+// 单个遮挡测试对象的统计
+struct occlusionObject {
+	std::string name;
+	unsigned int queries[2];	// 按帧交替使用，读上一帧的结果时不会等待本帧
+	bool issued[2];
+	bool visible;	// 最近一次拿到的查询结果
+	bool tested;	// 本帧发出了查询，可用于条件渲染
+	unsigned int frames;	// 参与测试的帧数
+	unsigned int culledFrames;	// 其中被判定为遮挡而跳过绘制的帧数
+};
+
+// 硬件遮挡查询：在遮挡物画完之后，以 GL_ANY_SAMPLES_PASSED 查询绘制各重物体的包围盒（不写颜色与深度）
+// CPU 端按上一帧的结果决定是否提交绘制，从不等待本帧的结果；
+// 提交的绘制再包在 glBeginConditionalRender(本帧查询, GL_QUERY_NO_WAIT) 中，结果已出时 GPU 直接跳过
+// 被判为遮挡的物体仍然每帧测试，重新露出后下一帧恢复绘制
+class OcclusionCuller {
+private:
+	std::vector<occlusionObject> objects;
+	Shader* boxShader;
+	unsigned int VAO, VBO, EBO;
+	unsigned int timers[2];	// 包围盒测试的 GPU 耗时，同样读上一帧的
+	bool timerIssued[2];
+	unsigned int frame;
+	unsigned char colorMask[4];
+	unsigned char depthMask;
+	bool cullFace;
+public:
+	// 上一帧包围盒测试的 GPU 耗时(ms)与本帧发出的查询数
+	double queryTime;
+	unsigned int queryCount;
+
+	// boxShader 为 shader/occlusion.vert + occlusion.frag
+	OcclusionCuller(Shader& _boxShader);
+	~OcclusionCuller();
+
+	unsigned int addObject(const std::string& name);
+	unsigned int size() const { return (unsigned int)objects.size(); }
+	const occlusionObject& object(unsigned int index) const { return objects[index]; }
+
+	// 在遮挡物之后、重物体之前调用，之间只能调用 test()
+	void beginTests();
+	// 读取上一帧的结果并为本帧发出查询，返回是否应提交绘制
+	// eye 位于包围盒内（含近平面余量）时直接判为可见，不发查询
+	bool test(unsigned int index, const boundingVolume& worldBounds, const glm::vec3& eye, float nearPlane);
+	void endTests();
+
+	// 包住一个重物体的绘制，本帧未发查询时什么也不做
+	void beginConditional(unsigned int index);
+	void endConditional(unsigned int index);
+};
+
+OcclusionCuller::OcclusionCuller(Shader& _boxShader) :
+	boxShader(&_boxShader), frame(0), depthMask(GL_TRUE), cullFace(false), queryTime(0.0), queryCount(0) {
+	// 单位立方体 [-1, 1]^3
+	float vertices[] = {
+		-1.f, -1.f, -1.f,	1.f, -1.f, -1.f,	1.f, 1.f, -1.f,	-1.f, 1.f, -1.f,
+		-1.f, -1.f, 1.f,	1.f, -1.f, 1.f,	1.f, 1.f, 1.f,	-1.f, 1.f, 1.f
+	};
+	unsigned int indices[] = {
+		0, 2, 1, 0, 3, 2,	4, 5, 6, 4, 6, 7,	0, 1, 5, 0, 5, 4,
+		3, 6, 2, 3, 7, 6,	0, 4, 7, 0, 7, 3,	1, 2, 6, 1, 6, 5
+	};
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenQueries(2, timers);
+	timerIssued[0] = timerIssued[1] = false;
+	colorMask[0] = colorMask[1] = colorMask[2] = colorMask[3] = GL_TRUE;
+}
+
+OcclusionCuller::~OcclusionCuller() {
+	for (occlusionObject& object : objects)
+		glDeleteQueries(2, object.queries);
+	glDeleteQueries(2, timers);
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+}
+
+unsigned int OcclusionCuller::addObject(const std::string& name) {
+	occlusionObject object;
+	object.name = name;
+	glGenQueries(2, object.queries);
+	object.issued[0] = object.issued[1] = false;
+	object.visible = true;
+	object.tested = false;
+	object.frames = 0;
+	object.culledFrames = 0;
+	objects.push_back(object);
+	return (unsigned int)objects.size() - 1;
+}
+
+void OcclusionCuller::beginTests() {
+	frame++;
+	queryCount = 0;
+	unsigned int current = frame & 1, previous = current ^ 1;
+	if (timerIssued[previous]) {
+		int available = GL_FALSE;
+		glGetQueryObjectiv(timers[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(timers[previous], GL_QUERY_RESULT, &elapsed);
+			queryTime = elapsed / 1e6;
+		}
+	}
+	glBeginQuery(GL_TIME_ELAPSED, timers[current]);
+	timerIssued[current] = true;
+
+	GLboolean mask[4];
+	glGetBooleanv(GL_COLOR_WRITEMASK, mask);
+	for (int i = 0; i < 4; i++) colorMask[i] = mask[i];
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	cullFace = glIsEnabled(GL_CULL_FACE) == GL_TRUE;
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+	boxShader->use();
+	glBindVertexArray(VAO);
+}
+
+bool OcclusionCuller::test(unsigned int index, const boundingVolume& worldBounds, const glm::vec3& eye, float nearPlane) {
+	occlusionObject& object = objects[index];
+	unsigned int current = frame & 1, previous = current ^ 1;
+	object.frames++;
+	object.tested = false;
+
+	// 上一帧的结果还没出来就沿用之前的判断
+	if (object.issued[previous]) {
+		int available = GL_FALSE;
+		glGetQueryObjectiv(object.queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint passed = 0;
+			glGetQueryObjectuiv(object.queries[previous], GL_QUERY_RESULT, &passed);
+			object.visible = passed != 0;
+		}
+		object.issued[previous] = false;
+	}
+
+	// 相机在盒内时包围盒的面会被近平面裁掉，查询结果不可信
+	glm::vec3 lo = worldBounds.min - glm::vec3(nearPlane * 2.f);
+	glm::vec3 hi = worldBounds.max + glm::vec3(nearPlane * 2.f);
+	if (eye.x >= lo.x && eye.y >= lo.y && eye.z >= lo.z && eye.x <= hi.x && eye.y <= hi.y && eye.z <= hi.z) {
+		object.visible = true;
+		return true;
+	}
+
+	glm::mat4 box = glm::translate(glm::mat4(1.f), worldBounds.center);
+	box = glm::scale(box, (worldBounds.max - worldBounds.min) * .5f);
+	boxShader->setMat4f("box"_u, box);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, object.queries[current]);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	object.issued[current] = true;
+	object.tested = true;
+	queryCount++;
+
+	if (!object.visible) object.culledFrames++;
+	return object.visible;
+}
+
+void OcclusionCuller::endTests() {
+	glBindVertexArray(0);
+	glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+	glDepthMask(depthMask);
+	if (cullFace) glEnable(GL_CULL_FACE);
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+void OcclusionCuller::beginConditional(unsigned int index) {
+	const occlusionObject& object = objects[index];
+	if (object.tested)
+		glBeginConditionalRender(object.queries[frame & 1], GL_QUERY_NO_WAIT);
+}
+
+void OcclusionCuller::endConditional(unsigned int index) {
+	if (objects[index].tested)
+		glEndConditionalRender();
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef PROGRAMPIPELINE_H
+#define PROGRAMPIPELINE_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <iostream>
+
+#include "GLExtension.h"
+#include "Shader_s.h"
+
+// 程序管线：把多个可分离程序（Shader::separable）的各阶段组合起来
+// 同一个顶点程序可以搭配不同的片段程序，切换片段阶段时顶点阶段及其 uniform 保持不变
+// 需要 ARB_separate_shader_objects，调用方在 glExt.separateShaderObjects 为 false 时走普通程序
+class ProgramPipeline {
+public:
+	unsigned int ID;
+	// 累计的阶段切换次数
+	unsigned int stageSwitches;
+
+	ProgramPipeline();
+	~ProgramPipeline();
+
+	// 解除 glUseProgram 的程序并绑定管线（当前程序优先于管线）
+	void bind();
+	// 用 program 提供 stages 所列阶段，stages 为 GL_*_SHADER_BIT 的组合
+	void useStages(GLbitfield stages, const Shader& program);
+	// 之后的 glUniform*（包括 Shader::set*）写到 program
+	void activeProgram(const Shader& program);
+	// 检查各阶段接口是否匹配，失败时打印日志
+	bool validate();
+};
+
+ProgramPipeline::ProgramPipeline() : ID(0), stageSwitches(0) {
+	glExt.GenProgramPipelines(1, &ID);
+}
+
+ProgramPipeline::~ProgramPipeline() {
+	glExt.DeleteProgramPipelines(1, &ID);
+}
+
+void ProgramPipeline::bind() {
+	glUseProgram(0);
+	glExt.BindProgramPipeline(ID);
+}
+
+void ProgramPipeline::useStages(GLbitfield stages, const Shader& program) {
+	glExt.UseProgramStages(ID, stages, program.ID);
+	stageSwitches++;
+}
+
+void ProgramPipeline::activeProgram(const Shader& program) {
+	glExt.ActiveShaderProgram(ID, program.ID);
+}
+
+bool ProgramPipeline::validate() {
+	glExt.ValidateProgramPipeline(ID);
+	int success = GL_FALSE;
+	glExt.GetProgramPipelineiv(ID, GL_VALIDATE_STATUS, &success);
+	if (!success) {
+		int length = 0;
+		glExt.GetProgramPipelineiv(ID, GL_INFO_LOG_LENGTH, &length);
+		std::vector<char> infoLog(length > 0 ? length : 1, '\0');
+		glExt.GetProgramPipelineInfoLog(ID, (GLsizei)infoLog.size(), NULL, infoLog.data());
+		std::cout << "ERROR::PROGRAMPIPELINE::VALIDATION_FAILED\n" << infoLog.data() << std::endl;
+	}
+	return success == GL_TRUE;
+}
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <functional>
+
+#include "Shader_s.h"
+#include "Std140.h"
+#include "UniformRing.h"
+#include "CommandList.h"
+#include <LearnOpenGL/mesh.h>
+
+// 有序号的材质纹理类型与编译期算好句柄的序号个数，超出的序号与其他类型在录制时现算哈希
+enum MaterialTextureType {
+	MATERIAL_DIFFUSE,
+	MATERIAL_SPECULAR,
+	MATERIAL_NORMAL,
+	MATERIAL_HEIGHT,
+	MATERIAL_TEXTURE_TYPES
+};
+static const unsigned int MATERIAL_TEXTURE_SLOTS = 4;
+
+// 绘制键，高位到低位：pass(4) | program(12) | material(16) | depth(32)
+// 按键升序提交即先按 pass，再按程序、材质（纹理组）聚合，同组内由近到远
+// program 与 material 取 GL 对象名的低位，截断只影响聚合效果，不影响正确性
+enum RenderPass {
+	PASS_OPAQUE = 0
+};
+
+// 排序前后各类状态切换次数，[0] 为提交顺序，[1] 为排序后
+struct renderQueueStats {
+	unsigned int draws;
+	unsigned int programSwitches[2];
+	unsigned int vaoSwitches[2];
+	unsigned int textureSwitches[2];
+
+	renderQueueStats() { std::memset(this, 0, sizeof(renderQueueStats)); }
+};
+
+class RenderQueue {
+private:
+	struct renderItem {
+		Shader* program;
+		const Mesh* mesh;
+		unsigned int objectOffset;	// 逐绘制 uniform 数据在 objectData 中的位置
+		unsigned int objectSize;
+	};
+	struct sortEntry {
+		unsigned long long key;
+		unsigned int item;
+	};
+
+	std::vector<renderItem> items;
+	std::vector<sortEntry> entries;
+	std::vector<sortEntry> scratch;
+	std::vector<unsigned char> objectData;
+	CommandList commands;	// execute() 用
+
+	void radixSort();
+	void countSwitches(int column);
+	static bool sameTextures(const Mesh& a, const Mesh& b);
+	static void recordTextures(CommandList& list, const Mesh& mesh);
+	// 纹理 type 的采样器句柄，numbers 为各类型下一个序号，取用后递增
+	static UniformHandle materialSampler(const std::string& type, unsigned int* numbers);
+public:
+	renderQueueStats stats;
+
+	// 按 Mesh::Draw 的约定绑定网格的纹理并设置采样器
+	static void bindTextures(Shader& program, const Mesh& mesh);
+
+	static unsigned long long makeKey(unsigned int pass, unsigned int program, unsigned int material, float depth);
+
+	// 每帧开始时清空
+	void clear();
+	// 提交一次绘制，object 为该绘制的逐对象 uniform 块，执行时写入环形缓冲
+	template <class... Ts>
+	void add(unsigned int pass, Shader& program, const Mesh& mesh, float depth, const Std140Block<Ts...>& object);
+	// 排序并把去重后的状态切换与绘制录制到 list，不调用 GL，可在工作线程中进行
+	void record(CommandList& list, unsigned int objectBinding);
+	// 在 GL 线程录制并立即回放，useProgram 负责切换程序（普通程序或程序管线的片段阶段）
+	void execute(UniformRingBuffer& ring, unsigned int objectBinding, const std::function<void(Shader&)>& useProgram);
+};
+
+unsigned long long RenderQueue::makeKey(unsigned int pass, unsigned int program, unsigned int material, float depth) {
+	// 非负浮点数的位模式与数值同序
+	unsigned int depthBits = 0;
+	if (depth > 0.f) std::memcpy(&depthBits, &depth, 4);
+	return ((unsigned long long)(pass & 0xF) << 60) | ((unsigned long long)(program & 0xFFF) << 48) |
+		((unsigned long long)(material & 0xFFFF) << 32) | depthBits;
+}
+
+void RenderQueue::clear() {
+	items.clear();
+	entries.clear();
+	objectData.clear();
+}
+
+template <class... Ts>
+void RenderQueue::add(unsigned int pass, Shader& program, const Mesh& mesh, float depth, const Std140Block<Ts...>& object) {
+	renderItem item;
+	item.program = &program;
+	item.mesh = &mesh;
+	item.objectOffset = (unsigned int)objectData.size();
+	item.objectSize = object.size();
+	objectData.insert(objectData.end(), object.data(), object.data() + object.size());
+
+	sortEntry entry;
+	entry.key = makeKey(pass, program.ID, mesh.textures.empty() ? 0 : mesh.textures[0].id, depth);
+	entry.item = (unsigned int)items.size();
+	entries.push_back(entry);
+	items.push_back(item);
+}
+
+// 8 趟 8 位 LSD 基数排序，稳定；某一字节全部相同时跳过该趟
+void RenderQueue::radixSort() {
+	scratch.resize(entries.size());
+	for (unsigned int shift = 0; shift < 64; shift += 8) {
+		unsigned int counts[256] = { 0 };
+		for (const sortEntry& entry : entries)
+			counts[(entry.key >> shift) & 0xFF]++;
+		if (counts[(entries[0].key >> shift) & 0xFF] == entries.size()) continue;
+		unsigned int offset = 0;
+		for (unsigned int& count : counts) {
+			unsigned int n = count;
+			count = offset;
+			offset += n;
+		}
+		for (const sortEntry& entry : entries)
+			scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+		entries.swap(scratch);
+	}
+}
+
+void RenderQueue::countSwitches(int column) {
+	const Shader* program = NULL;
+	const Mesh* textured = NULL;
+	unsigned int vao = 0;
+	for (const sortEntry& entry : entries) {
+		const renderItem& item = items[entry.item];
+		if (item.program != program) {
+			program = item.program;
+			stats.programSwitches[column]++;
+			textured = NULL;
+		}
+		if (!textured || !sameTextures(*textured, *item.mesh)) {
+			textured = item.mesh;
+			stats.textureSwitches[column]++;
+		}
+		if (item.mesh->VAO != vao) {
+			vao = item.mesh->VAO;
+			stats.vaoSwitches[column]++;
+		}
+	}
+}
+
+bool RenderQueue::sameTextures(const Mesh& a, const Mesh& b) {
+	if (a.textures.size() != b.textures.size()) return false;
+	for (std::size_t i = 0; i < a.textures.size(); i++)
+		if (a.textures[i].id != b.textures[i].id) return false;
+	return true;
+}
+
+// 与 Mesh::Draw 相同的约定：采样器名为 material.<type><序号>，各类型的序号从 1 开始
+UniformHandle RenderQueue::materialSampler(const std::string& type, unsigned int* numbers) {
+	static const char* const types[MATERIAL_TEXTURE_TYPES] = {
+		"texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+	static const UniformHandle handles[MATERIAL_TEXTURE_TYPES][MATERIAL_TEXTURE_SLOTS] = {
+		{ "material.texture_diffuse1"_u, "material.texture_diffuse2"_u, "material.texture_diffuse3"_u, "material.texture_diffuse4"_u },
+		{ "material.texture_specular1"_u, "material.texture_specular2"_u, "material.texture_specular3"_u, "material.texture_specular4"_u },
+		{ "material.texture_normal1"_u, "material.texture_normal2"_u, "material.texture_normal3"_u, "material.texture_normal4"_u },
+		{ "material.texture_height1"_u, "material.texture_height2"_u, "material.texture_height3"_u, "material.texture_height4"_u } };
+	for (unsigned int t = 0; t < MATERIAL_TEXTURE_TYPES; t++) {
+		if (type != types[t]) continue;
+		unsigned int number = numbers[t]++;
+		if (number <= MATERIAL_TEXTURE_SLOTS) return handles[t][number - 1];
+		std::string name = "material." + type + std::to_string(number);
+		return UniformHandle(uniformHash(name.c_str(), name.size()));
+	}
+	std::string name = "material." + type;
+	return UniformHandle(uniformHash(name.c_str(), name.size()));
+}
+
+// 第 i 张纹理绑定到纹理单元 i
+void RenderQueue::bindTextures(Shader& program, const Mesh& mesh) {
+	unsigned int numbers[MATERIAL_TEXTURE_TYPES] = { 1, 1, 1, 1 };
+	for (unsigned int i = 0; i < mesh.textures.size(); i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		program.setInt(materialSampler(mesh.textures[i].type, numbers), i);
+		glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// 与 bindTextures 相同的约定，以命令形式录制
+void RenderQueue::recordTextures(CommandList& list, const Mesh& mesh) {
+	unsigned int numbers[MATERIAL_TEXTURE_TYPES] = { 1, 1, 1, 1 };
+	for (unsigned int i = 0; i < mesh.textures.size(); i++) {
+		list.setInt(materialSampler(mesh.textures[i].type, numbers), i);
+		list.bindTexture(i, mesh.textures[i].id);
+	}
+}
+
+void RenderQueue::record(CommandList& list, unsigned int objectBinding) {
+	stats = renderQueueStats();
+	stats.draws = (unsigned int)entries.size();
+	if (entries.empty()) return;
+	countSwitches(0);
+	radixSort();
+	countSwitches(1);
+
+	Shader* program = NULL;
+	const Mesh* textured = NULL;
+	unsigned int vao = 0;
+	for (const sortEntry& entry : entries) {
+		const renderItem& item = items[entry.item];
+		if (item.program != program) {
+			program = item.program;
+			list.useProgram(*program);
+			// 采样器 uniform 属于程序，换程序后要重新设置
+			textured = NULL;
+		}
+		if (!textured || !sameTextures(*textured, *item.mesh)) {
+			textured = item.mesh;
+			recordTextures(list, *item.mesh);
+		}
+		if (item.mesh->VAO != vao) {
+			vao = item.mesh->VAO;
+			list.bindVertexArray(vao);
+		}
+		list.bindUniformBlock(objectBinding, &objectData[item.objectOffset], item.objectSize);
+		list.drawElements((unsigned int)item.mesh->indices.size());
+	}
+	list.bindVertexArray(0);
+}
+
+void RenderQueue::execute(UniformRingBuffer& ring, unsigned int objectBinding, const std::function<void(Shader&)>& useProgram) {
+	commands.clear();
+	record(commands, objectBinding);
+	replayCommandList(commands, ring, useProgram);
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+#include "TransformBatch.h"
+
+// 场景节点：局部 TRS 与缓存的世界矩阵、法线矩阵
+struct sceneNode {
+	int parent;	// 父节点下标，根节点为 -1
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+	glm::mat4 world;
+	glm::mat4 normal;	// transpose(inverse(world)) 的左上 3x3，以 mat4 存放便于直接写入 uniform 块
+	bool dirty;	// 局部变换改过，等待 update()
+	bool changed;	// 最近一次 update() 中世界矩阵被重算
+
+	sceneNode() : parent(-1), position(0.f), rotation(1.f, 0.f, 0.f, 0.f), scale(1.f),
+		world(1.f), normal(1.f), dirty(true), changed(false) {}
+};
+
+// 变换层级，节点连续存放且父节点总在子节点之前，update() 一次线性扫描即可完成传播
+// 只有自身或祖先被修改过的节点才重算世界矩阵与法线矩阵，静止物体每帧没有开销
+class SceneGraph {
+private:
+	std::vector<sceneNode> nodes;
+public:
+	// 最近一次 update() 重算的节点数
+	unsigned int updatedCount;
+
+	SceneGraph() : updatedCount(0) {}
+
+	// parent 必须是已有节点，因此新节点下标总大于父节点
+	unsigned int createNode(int parent = -1);
+	unsigned int size() const { return (unsigned int)nodes.size(); }
+
+	void setPosition(unsigned int node, const glm::vec3& position);
+	void setRotation(unsigned int node, const glm::quat& rotation);
+	void setRotation(unsigned int node, float angle, const glm::vec3& axis);
+	void setScale(unsigned int node, const glm::vec3& scale);
+	void setLocal(unsigned int node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+	// 传播脏标记并重算受影响节点，每帧绘制前调用一次
+	void update();
+
+	const glm::mat4& world(unsigned int node) const { return nodes[node].world; }
+	const glm::mat4& normalMatrix(unsigned int node) const { return nodes[node].normal; }
+	bool changed(unsigned int node) const { return nodes[node].changed; }
+};
+
+unsigned int SceneGraph::createNode(int parent) {
+	sceneNode node;
+	node.parent = parent < (int)nodes.size() ? parent : -1;
+	nodes.push_back(node);
+	return (unsigned int)nodes.size() - 1;
+}
+
+void SceneGraph::setPosition(unsigned int node, const glm::vec3& position) {
+	nodes[node].position = position;
+	nodes[node].dirty = true;
+}
+
+void SceneGraph::setRotation(unsigned int node, const glm::quat& rotation) {
+	nodes[node].rotation = rotation;
+	nodes[node].dirty = true;
+}
+
+void SceneGraph::setRotation(unsigned int node, float angle, const glm::vec3& axis) {
+	setRotation(node, glm::angleAxis(angle, glm::normalize(axis)));
+}
+
+void SceneGraph::setScale(unsigned int node, const glm::vec3& scale) {
+	nodes[node].scale = scale;
+	nodes[node].dirty = true;
+}
+
+void SceneGraph::setLocal(unsigned int node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+	nodes[node].position = position;
+	nodes[node].rotation = rotation;
+	nodes[node].scale = scale;
+	nodes[node].dirty = true;
+}
+
+void SceneGraph::update() {
+	updatedCount = 0;
+	for (sceneNode& node : nodes) {
+		// 父节点在前，此时它的 changed 已经是本次的结果
+		const sceneNode* parent = node.parent >= 0 ? &nodes[node.parent] : NULL;
+		node.changed = node.dirty || (parent && parent->changed);
+		if (!node.changed) continue;
+
+		// local = T * R * S，与 translate/rotate/scale 依次右乘的结果一致
+		glm::mat4 local = glm::mat4_cast(node.rotation);
+		local[0] *= node.scale.x;
+		local[1] *= node.scale.y;
+		local[2] *= node.scale.z;
+		local[3] = glm::vec4(node.position, 1.f);
+		node.world = parent ? parent->world * local : local;
+		node.normal = affineNormalMatrix(node.world);
+		node.dirty = false;
+		updatedCount++;
+	}
+}
+
+#endif
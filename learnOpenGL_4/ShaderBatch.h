@@ -0,0 +1,141 @@
+#ifndef SHADERBATCH_H
+#define SHADERBATCH_H
+
+#include "Shader_s.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+
+// 一批着色器程序的异步构建
+// 源码在线程池中并行读取，所有程序先全部提交给驱动再检查状态，帧循环中用 poll() 不阻塞地等待
+class ShaderBatch {
+private:
+	struct shaderJob {
+		Shader* shader;
+		const char* paths[3];	// vertex, fragment, geometry(可为空)
+		std::string codes[3];
+		double readTimes[3];
+		std::string defines;
+		bool done;
+	};
+
+	std::vector<shaderJob> jobs;
+	std::chrono::steady_clock::time_point submitTime;
+	bool submitted;
+	bool reported;
+
+	void readSources();
+	void report();
+public:
+	// 从提交到全部完成的耗时(ms)与命中程序二进制缓存的程序数
+	double buildTime;
+	unsigned int cacheHits;
+	// 完成时打印 SHADER::STARTUP 统计，测量启动时间时打开
+	bool printReport;
+
+	ShaderBatch() : submitted(false), reported(false), buildTime(0.0), cacheHits(0), printReport(false) {}
+	unsigned int size() const { return (unsigned int)jobs.size(); }
+
+	// shader 需在 poll() 返回 true 之前保持有效
+	void add(Shader& shader, const char* vertexPath, const char* fragmentPath, const char* geometryPath = NULL,
+		const std::string& defines = std::string());
+	void submit();
+	// 不阻塞，全部完成时返回 true
+	bool poll();
+	// 阻塞直到全部完成
+	void wait();
+};
+
+void ShaderBatch::add(Shader& shader, const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+	const std::string& defines) {
+	shaderJob job;
+	job.shader = &shader;
+	job.paths[0] = vertexPath;
+	job.paths[1] = fragmentPath;
+	job.paths[2] = geometryPath;
+	job.defines = defines;
+	job.readTimes[0] = job.readTimes[1] = job.readTimes[2] = 0.0;
+	job.done = false;
+	jobs.push_back(job);
+}
+
+// 文件读取与预处理与 GL 无关，放到工作线程
+void ShaderBatch::readSources() {
+	std::vector<std::pair<unsigned int, unsigned int> > files;
+	for (unsigned int i = 0; i < jobs.size(); i++)
+		for (unsigned int j = 0; j < 3; j++)
+			if (jobs[i].paths[j]) files.push_back(std::make_pair(i, j));
+
+	std::atomic<unsigned int> next(0);
+	auto worker = [&]() {
+		for (unsigned int k = next++; k < files.size(); k = next++) {
+			shaderJob& job = jobs[files[k].first];
+			const char* path = job.paths[files[k].second];
+			job.codes[files[k].second] = loadShaderSource(path, job.defines, job.readTimes[files[k].second]);
+		}
+	};
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 2;
+	if (threadCount > files.size()) threadCount = (unsigned int)files.size();
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadCount; i++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void ShaderBatch::submit() {
+	submitTime = std::chrono::steady_clock::now();
+	readSources();
+	// GL 调用只能在上下文线程，先全部提交，驱动可在后台并行编译
+	for (shaderJob& job : jobs) {
+		job.shader->beginBuild(job.codes[0], job.codes[1], job.codes[2], job.defines);
+		for (int i = 0; i < 3; i++)
+			if (job.paths[i]) job.shader->recordSource(i, job.paths[i], job.readTimes[i]);
+	}
+	submitted = true;
+}
+
+bool ShaderBatch::poll() {
+	if (!submitted) return false;
+	bool complete = true;
+	for (shaderJob& job : jobs) {
+		if (job.done) continue;
+		if (job.shader->isBuildComplete()) {
+			job.shader->finishBuild();
+			job.done = true;
+			// 源码已不再需要
+			for (std::string& code : job.codes)
+				std::string().swap(code);
+		}
+		else complete = false;
+	}
+	if (complete && !reported) report();
+	return complete;
+}
+
+void ShaderBatch::wait() {
+	if (!submitted) submit();
+	while (!poll())
+		std::this_thread::yield();
+}
+
+void ShaderBatch::report() {
+	reported = true;
+	buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitTime).count();
+	cacheHits = 0;
+	for (const shaderJob& job : jobs)
+		if (job.shader->fromBinaryCache) cacheHits++;
+	if (!printReport) return;
+	std::cout << "SHADER::STARTUP " << buildTime << " ms, " << jobs.size() << " programs, binary cache ";
+	if (glExt.programBinary) std::cout << cacheHits << "/" << jobs.size();
+	else std::cout << "unsupported";
+	std::cout << ", parallel compile " << (glExt.parallelShaderCompile ? "on" : "off") << std::endl;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include "Shader_s.h"
+#include "ShaderBatch.h"
+
+#include <map>
+#include <vector>
+#include <string>
+
+// 着色器变体：同一组源码按特性位注入不同的 #define，各组合按需编译并缓存
+// 第 i 个特性名对应键的第 i 位，渲染循环按当前状态取特化的程序，着色器里不再有运行时分支
+// vertexPath 为 NULL 时只编译片段阶段，得到可分离程序，与共享的顶点程序在 ProgramPipeline 中组合
+class ShaderVariants {
+private:
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::vector<std::string> features;
+	std::map<unsigned int, Shader*> variants;
+
+public:
+	ShaderVariants(const char* _vertexPath, const char* _fragmentPath, const std::vector<std::string>& _features) :
+		vertexPath(_vertexPath ? _vertexPath : ""), fragmentPath(_fragmentPath), features(_features) {}
+	~ShaderVariants();
+
+	// 由特性位生成宏定义
+	std::string defines(unsigned int key) const;
+	// 已有则直接返回，否则同步编译
+	Shader& get(unsigned int key);
+	// 加入批次异步构建，用于启动时预热
+	void prepare(unsigned int key, ShaderBatch& batch);
+	unsigned int size() const { return (unsigned int)variants.size(); }
+};
+
+ShaderVariants::~ShaderVariants() {
+	for (auto& variant : variants) {
+		glDeleteProgram(variant.second->ID);
+		delete variant.second;
+	}
+}
+
+std::string ShaderVariants::defines(unsigned int key) const {
+	std::string result;
+	for (unsigned int i = 0; i < features.size(); i++)
+		if (key & (1u << i))
+			result += "#define " + features[i] + "\n";
+	return result;
+}
+
+Shader& ShaderVariants::get(unsigned int key) {
+	auto it = variants.find(key);
+	if (it != variants.end()) return *it->second;
+
+	std::string macros = defines(key);
+	Shader* shader = new Shader();
+	shader->separable = vertexPath.empty();
+	double readTimes[2] = { 0.0, 0.0 };
+	std::string vertexCode = shader->separable ? std::string() : loadShaderSource(vertexPath.c_str(), macros, readTimes[0]);
+	std::string fragmentCode = loadShaderSource(fragmentPath.c_str(), macros, readTimes[1]);
+	shader->beginBuild(vertexCode, fragmentCode, std::string(), macros);
+	if (!shader->separable) shader->recordSource(0, vertexPath, readTimes[0]);
+	shader->recordSource(1, fragmentPath, readTimes[1]);
+	shader->finishBuild();
+	variants[key] = shader;
+	return *shader;
+}
+
+void ShaderVariants::prepare(unsigned int key, ShaderBatch& batch) {
+	if (variants.count(key)) return;
+	Shader* shader = new Shader();
+	shader->separable = vertexPath.empty();
+	variants[key] = shader;
+	batch.add(*shader, shader->separable ? NULL : vertexPath.c_str(), fragmentPath.c_str(), NULL, defines(key));
+}
+
+#endif
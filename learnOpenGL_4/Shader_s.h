@@ -7,27 +7,160 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <map>
+#include <set>
+#include <vector>
 #include <string>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+#include "GLExtension.h"
+#include "Std140.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define SHADER_MKDIR(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define SHADER_MKDIR(path) mkdir(path, 0755)
+#endif
+
+// 程序二进制缓存目录，键变化（源码、宏、驱动）时自然落到新文件上
+#define SHADER_CACHE_DIR "shader_cache"
+#define SHADER_CACHE_MAGIC 0x31425053u	// "SPB1"
 
 struct uniformStruct{
 	unsigned int base;	// 基准对齐量
 	unsigned int offset;	// 偏移量
+	unsigned int hash;	// 名字的 FNV-1a 哈希
+	unsigned int matrixStride;	// 矩阵相邻列的间距，非矩阵为 0
+	unsigned int arrayStride;	// 数组相邻元素的间距，非数组为 0
+	unsigned int arraySize;	// 数组长度
 
-	uniformStruct() { base = 0; offset = 0; }
+	uniformStruct() { base = 0; offset = 0; hash = 0; matrixStride = 0; arrayStride = 0; arraySize = 0; }
 	uniformStruct(unsigned int _base, unsigned int _offset) :
-		base(_base), offset(_offset) {};
+		base(_base), offset(_offset), hash(0), matrixStride(0), arrayStride(0), arraySize(0) {};
+};
+
+// uniform 名字的 FNV-1a 哈希，constexpr 以便在编译期求值
+constexpr unsigned int uniformHash(const char* str, std::size_t len) {
+	unsigned int hash = 2166136261u;
+	for (std::size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// 编译期哈希好的 uniform 句柄，用法: shader.setVec3f("pointLight.position"_u, pos)
+struct UniformHandle {
+	unsigned int hash;
+
+	constexpr explicit UniformHandle(unsigned int _hash) : hash(_hash) {}
+};
+
+constexpr UniformHandle operator"" _u(const char* str, std::size_t len) {
+	return UniformHandle(uniformHash(str, len));
+}
+
+// 哈希必须是常量表达式：static_assert 在编译期求值，实现若退化为运行期计算这里就无法编译
+// 前三个是 FNV-1a 的标准测试向量，最后一个检查 _u 本身
+static_assert(uniformHash("", 0) == 0x811c9dc5u, "uniformHash must be FNV-1a");
+static_assert(uniformHash("a", 1) == 0xe40c292cu, "uniformHash must be FNV-1a");
+static_assert(uniformHash("foobar", 6) == 0xbf9cf968u, "uniformHash must be FNV-1a");
+static_assert("pointLights[0].position"_u.hash == 0xdc3b43d7u, "_u must hash at compile time");
+
+// uniform 位置表的槽位，location 为 -1 表示空槽
+struct uniformSlot {
+	unsigned int hash;
+	int location;
+	int value;	// 在上次写入值表中的下标，同一位置的别名共用
+	bool collided;	// 与另一个 uniform 哈希相同，句柄无法区分，只能按名字查找
+	std::string name;
+
+	uniformSlot() { hash = 0; location = -1; value = -1; collided = false; }
+};
+
+// 某个 uniform 位置上次写入的值，相同的值不再提交给驱动
+struct uniformValue {
+	bool valid;
+	bool tracked;	// false 时每次都写入，用于着色器外部（或其他途径）会改动的 uniform
+	unsigned int size;
+	unsigned char data[64];
+
+	uniformValue() { valid = false; tracked = true; size = 0; }
+};
+
+// 所有程序合计的 uniform 写入次数，每帧开始时清零
+struct uniformWriteStats {
+	unsigned int issued;
+	unsigned int skipped;
+
+	uniformWriteStats() { issued = 0; skipped = 0; }
+};
+
+// 单个阶段的构建记录，时间单位 ms
+struct shaderStageReport {
+	bool present;
+	std::string path;
+	double readTime;	// 读取与预处理
+	double compileTime;	// 提交编译与查询结果
+	bool compiled;
+	std::string infoLog;
+
+	shaderStageReport() { present = false; readTime = 0.0; compileTime = 0.0; compiled = false; }
+};
+
+// 一个程序的构建记录，stages 依次为 vertex、fragment、geometry
+struct shaderBuildReport {
+	shaderStageReport stages[3];
+	std::string defines;
+	bool separable;
+	bool fromBinaryCache;
+	double linkTime;	// 提交链接（或载入二进制）与查询结果
+	double totalTime;	// beginBuild 到 finishBuild 结束，含异步编译的等待
+	bool linked;
+	std::string infoLog;
+	int activeUniforms;
+	int activeAttributes;
+	int activeUniformBlocks;
+
+	shaderBuildReport() {
+		separable = false; fromBinaryCache = false; linkTime = 0.0; totalTime = 0.0; linked = false;
+		activeUniforms = 0; activeAttributes = 0; activeUniformBlocks = 0;
+	}
 };
 
 class Shader {
 public:
 	// 程序ID
 	unsigned int ID;
+	// 被位置表省下的 glGetUniformLocation 调用次数
+	mutable unsigned long long uniformLookupsAvoided;
+	// 本次是否由程序二进制缓存直接载入
+	bool fromBinaryCache;
+	// 构建前设为 true 则链接为可分离程序，可以只含部分阶段，供 ProgramPipeline 组合
+	bool separable;
+	// 最近一次构建的诊断信息
+	shaderBuildReport report;
 
+	Shader();
 	Shader(const char* vertexPath, const char* fragmentPath);
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath);
+	// 异步构建：beginBuild 只提交，isBuildComplete 不阻塞地轮询，finishBuild 检查结果
+	void beginBuild(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode = std::string(),
+		const std::string& defines = std::string());
+	bool isBuildComplete() const;
+	void finishBuild();
+	// 记录第 stage 个阶段(0 vertex, 1 fragment, 2 geometry)的源文件与读取耗时，在 beginBuild 之后调用
+	void recordSource(int stage, const std::string& path, double readTime);
+	// 本进程中所有已完成的构建记录
+	static std::vector<shaderBuildReport>& buildReports();
 	void use();
 	// uniform工具函数
 	void setBool(const std::string& name, bool value) const;
@@ -41,28 +174,96 @@ public:
 	void setMat4f(const std::string& name, GLfloat* value, int count);
 	void setMat4f(const std::string& name, glm::mat4 value, int count);
 	void uniformBlockBinding(const std::string& name, unsigned int index);
-	
+	// 之后构建的每个程序都把名为 name 的 uniform 块绑定到 index
+	static void defaultBlockBinding(const std::string& name, unsigned int index);
+	// 句柄版本，只按哈希查表，没有字符串构造与比较
+	void setBool(UniformHandle handle, bool value) const;
+	void setInt(UniformHandle handle, int value) const;
+	void setFloat(UniformHandle handle, float value);
+	void setVec2f(UniformHandle handle, float xValue, float yValue);
+	void setVec2f(UniformHandle handle, glm::vec2 value);
+	void setVec3f(UniformHandle handle, float xValue, float yValue, float zValue);
+	void setVec3f(UniformHandle handle, glm::vec3 value);
+	void setMat4f(UniformHandle handle, int count, GLfloat* value);
+	void setMat4f(UniformHandle handle, GLfloat* value, int count = 1);
+	void setMat4f(UniformHandle handle, glm::mat4 value, int count = 1);
+	// 查表得到 uniform 位置，可在渲染循环外预先取好
+	int getUniformLocation(const std::string& name) const;
+	int getUniformLocation(UniformHandle handle) const;
+	// 关闭/恢复某个 uniform 的冗余写入消除
+	void setUniformCaching(const std::string& name, bool enabled);
+	void setUniformCaching(UniformHandle handle, bool enabled);
+	// 绕过 set* 直接调用 glUniform* 之后调用，使记录的值全部失效
+	void invalidateUniformCache() const;
+	static uniformWriteStats& writeStats();
+	static void resetWriteStats() { writeStats() = uniformWriteStats(); }
+
+private:
+	// 链接后枚举的活跃 uniform，开放寻址，容量为 2 的幂
+	std::vector<uniformSlot> uniformTable;
+	unsigned int uniformCount;
+	// 各位置上次写入的值
+	mutable std::vector<uniformValue> uniformValues;
+	// 构建中的各阶段着色器（没有该阶段时为 0）与缓存键
+	unsigned int stages[3];
+	unsigned long long cacheKey;
+	bool building;
+	std::chrono::steady_clock::time_point buildStart;
+
+	void cacheUniformLocations();
+	static std::vector<std::pair<std::string, unsigned int> >& defaultBlockBindings();
+	// 程序二进制缓存
+	unsigned long long programCacheKey(const std::string* sources[], int count, const std::string& defines);
+	bool loadProgramBinary(unsigned long long key);
+	void saveProgramBinary(unsigned long long key);
+	void insertUniformLocation(const std::string& name, int location, int value);
+	const uniformSlot* findUniform(const std::string& name) const;
+	const uniformSlot* findUniform(UniformHandle handle) const;
+	// 值与上次相同时返回 false，调用方据此跳过 glUniform*
+	bool updateUniformValue(const uniformSlot* slot, const void* data, unsigned int size) const;
 };
 
 class UniformBufferManager {
 private:
-	std::map<std::string, uniformStruct>* uniformBufferStruct;
+	// 按哈希排序的布局表，连续存放
+	std::vector<uniformStruct> layout;
+	// 按调用顺序手工推算偏移时的当前位置，布局来自反射时不使用
 	unsigned int index;
+	bool reflected;
+	// CPU 端影子缓冲与脏区间 [dirtyBegin, dirtyEnd)
+	std::vector<unsigned char> shadow;
+	unsigned int dirtyBegin;
+	unsigned int dirtyEnd;
 
 	unsigned int createUniformBuffer(GLsizeiptr size, GLenum usage);
+	const uniformStruct* findUniform(unsigned int hash) const;
+	void addUniform(const uniformStruct& uniform);
+	// 返回写入偏移，未登记时按 std140 规则追加；反射布局中不存在时返回 UINT_MAX
+	unsigned int resolveOffset(const std::string& name, unsigned int size, unsigned int align);
+	// 数组整体的布局，未登记时按 std140 追加 count 个 stride 的元素；反射布局中不存在时返回 NULL
+	const uniformStruct* resolveArray(const std::string& name, unsigned int stride, unsigned int count);
+	void write(unsigned int offset, const void* data, unsigned int size);
+	void markDirty(unsigned int offset, unsigned int size);
 public:
 	unsigned int ID;
+	// 累计的 glBufferSubData 次数
+	unsigned long long uploadCount;
 
 	UniformBufferManager(GLsizeiptr size, GLenum usage = GL_STATIC_DRAW) {
-		uniformBufferStruct = new std::map<std::string, uniformStruct>;
+		reflected = false;
 		ID = createUniformBuffer(size, usage);
 	}
+	// 偏移、数组步长、矩阵步长取自着色器中 blockName 的反射信息
+	UniformBufferManager(const Shader& shader, const std::string& blockName, GLenum usage = GL_DYNAMIC_DRAW);
 	~UniformBufferManager() {
-		delete uniformBufferStruct;
-		glDeleteBuffers(GL_UNIFORM_BUFFER, &ID);
+		glDeleteBuffers(1, &ID);
 	}
 
 	void uniformBufferBinding(unsigned index);
+	// 把本帧合并后的脏区间一次性上传，每帧调用一次
+	void flush();
+	unsigned int size() const { return (unsigned int)shadow.size(); }
+	const unsigned char* data() const { return shadow.data(); }
 	void setUniformBufferBool(const std::string& name, int value);
 	void setUniformBufferInt(const std::string name, int value);
 	void setUniformBufferIntArray(const std::string name, unsigned int size, int value[]);
@@ -76,165 +277,410 @@ public:
 	void setUniformBufferVec4fArray(const std::string name, unsigned int size, glm::vec4 value[]);
 	void setUniformBufferMat3f(const std::string name, glm::mat3 value);
 	void setUniformBufferMat4f(const std::string name, glm::mat4 value);
+	// 整块按编译期 std140 布局一次写入影子缓冲，不经过名字查表
+	template <class... Ts>
+	void setUniformBlock(const Std140Block<Ts...>& block);
+	// 数组一次查表，按 std140 步长整段写入，flush 时随脏区间一次上传；T 可以是 Std140<T> 支持的任意类型
+	template <class T>
+	void setUniformBufferArray(const std::string& name, const T* values, unsigned int count);
 };
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
-{
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-
+// 读取整个着色器文件，可在工作线程中调用
+std::string readShaderFile(const char* path) {
+	std::ifstream shaderFile;
 	// 异常处理
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 	try {
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream;
-		std::stringstream fShaderStream;
+		shaderFile.open(path);
+		std::stringstream shaderStream;
 		// 读取缓存内容到数据流
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		vShaderFile.close();
-		fShaderFile.close();
-
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+		shaderStream << shaderFile.rdbuf();
+		shaderFile.close();
+		return shaderStream.str();
 	}
 	catch (std::ifstream::failure error) {
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ\n" << path << std::endl;
 	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
+	return std::string();
+}
 
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
+std::string expandShaderIncludes(const std::string& code, const std::string& path, const std::string& defines, std::set<std::string>& included) {
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	std::istringstream stream(code);
+	std::ostringstream out;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(stream, line)) {
+		lineNumber++;
+		std::size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos) {
+			out << line << "\n";
+			continue;
+		}
+		// 宏紧跟在 #version 之后，#line 保持报错行号与原文件一致
+		if (line.compare(start, 8, "#version") == 0 && !defines.empty()) {
+			out << line << "\n" << defines << "#line " << lineNumber + 1 << "\n";
+			continue;
+		}
+		if (line.compare(start, 8, "#include") == 0) {
+			std::size_t open = line.find('"', start);
+			std::size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close != std::string::npos) {
+				std::string includePath = directory + line.substr(open + 1, close - open - 1);
+				// 同一文件只展开一次
+				if (included.insert(includePath).second)
+					out << "#line 1\n" << expandShaderIncludes(readShaderFile(includePath.c_str()), includePath, "", included);
+				out << "#line " << lineNumber + 1 << "\n";
+				continue;
+			}
+		}
+		out << line << "\n";
+	}
+	return out.str();
+}
 
-	// vertex
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATTON_FAILED\n" << infoLog << std::endl;
+// 着色器预处理：在 #version 之后注入宏，并展开 #include "file"（路径相对当前文件）
+std::string preprocessShader(const std::string& code, const std::string& path, const std::string& defines) {
+	std::set<std::string> included;
+	included.insert(path);
+	return expandShaderIncludes(code, path, defines, included);
+}
+
+double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 读取并预处理，readTime 返回耗时(ms)，可在工作线程中调用
+std::string loadShaderSource(const char* path, const std::string& defines, double& readTime) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::string code = preprocessShader(readShaderFile(path), path, defines);
+	readTime = elapsedMilliseconds(start);
+	return code;
+}
+
+// 完整长度的日志，不再截断到固定缓冲
+std::string shaderInfoLog(unsigned int shader) {
+	int length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	if (length <= 1) return std::string();
+	std::vector<char> log(length);
+	glGetShaderInfoLog(shader, length, NULL, log.data());
+	return std::string(log.data());
+}
+
+std::string programInfoLog(unsigned int program) {
+	int length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	if (length <= 1) return std::string();
+	std::vector<char> log(length);
+	glGetProgramInfoLog(program, length, NULL, log.data());
+	return std::string(log.data());
+}
+
+Shader::Shader() :
+	ID(0), uniformLookupsAvoided(0), fromBinaryCache(false), separable(false), uniformCount(0), cacheKey(0), building(false) {
+	stages[0] = stages[1] = stages[2] = 0;
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath) : Shader()
+{
+	double readTimes[2];
+	std::string vertexCode = loadShaderSource(vertexPath, "", readTimes[0]);
+	std::string fragmentCode = loadShaderSource(fragmentPath, "", readTimes[1]);
+	beginBuild(vertexCode, fragmentCode);
+	recordSource(0, vertexPath, readTimes[0]);
+	recordSource(1, fragmentPath, readTimes[1]);
+	finishBuild();
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath) : Shader()
+{
+	double readTimes[3];
+	std::string vertexCode = loadShaderSource(vertexPath, "", readTimes[0]);
+	std::string fragmentCode = loadShaderSource(fragmentPath, "", readTimes[1]);
+	std::string geometryCode = loadShaderSource(geometryPath, "", readTimes[2]);
+	beginBuild(vertexCode, fragmentCode, geometryCode);
+	recordSource(0, vertexPath, readTimes[0]);
+	recordSource(1, fragmentPath, readTimes[1]);
+	recordSource(2, geometryPath, readTimes[2]);
+	finishBuild();
+}
+
+// 提交编译与链接但不查询状态，驱动可以在后台完成
+void Shader::beginBuild(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode,
+	const std::string& defines) {
+	building = true;
+	buildStart = std::chrono::steady_clock::now();
+	report = shaderBuildReport();
+	report.defines = defines;
+	report.separable = separable;
+
+	// 命中程序二进制缓存时跳过编译与链接
+	const std::string* sources[] = { &vertexCode, &fragmentCode, &geometryCode };
+	for (int i = 0; i < 3; i++)
+		report.stages[i].present = !sources[i]->empty();
+	cacheKey = programCacheKey(sources, 3, defines);
+	if (loadProgramBinary(cacheKey)) {
+		report.linkTime = elapsedMilliseconds(buildStart);
+		return;
 	}
 
-	// fragment
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	glGetShaderiv(fragment, GL_FRAGMENT_SHADER, &success);
-	if (!success) {
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROE::SHADER::FRAGMENT::COMPILATTON_FAILED\n" << infoLog << std::endl;
+	const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+	for (int i = 0; i < 3; i++) {
+		stages[i] = 0;
+		// 空源码表示没有该阶段
+		if (sources[i]->empty()) continue;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const char* code = sources[i]->c_str();
+		stages[i] = glCreateShader(types[i]);
+		glShaderSource(stages[i], 1, &code, NULL);
+		glCompileShader(stages[i]);
+		report.stages[i].compileTime = elapsedMilliseconds(start);
 	}
 
 	// shader program
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
+	for (unsigned int stage : stages)
+		if (stage) glAttachShader(ID, stage);
+	if (glExt.programBinary)
+		glExt.ProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	if (separable && glExt.separateShaderObjects)
+		glExt.ProgramParameteri(ID, GL_PROGRAM_SEPARABLE, GL_TRUE);
 	glLinkProgram(ID);
-	glGetProgramiv(ID, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(ID, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-	}
+	report.linkTime = elapsedMilliseconds(start);
+}
 
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+void Shader::recordSource(int stage, const std::string& path, double readTime) {
+	report.stages[stage].path = path;
+	report.stages[stage].readTime = readTime;
 }
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
-{
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::string geometryCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	std::ifstream gShaderFile;
+std::vector<shaderBuildReport>& Shader::buildReports() {
+	static std::vector<shaderBuildReport> reports;
+	return reports;
+}
 
-	// 异常处理
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try {
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		gShaderFile.open(geometryPath);
-		std::stringstream vShaderStream;
-		std::stringstream fShaderStream;
-		std::stringstream gShaderStream;
-		// 读取缓存内容到数据流
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		gShaderStream << gShaderFile.rdbuf();
-		vShaderFile.close();
-		fShaderFile.close();
-		gShaderFile.close();
+std::string jsonEscape(const std::string& str) {
+	std::string result;
+	for (char c : str) {
+		switch (c) {
+		case '"': result += "\\\""; break;
+		case '\\': result += "\\\\"; break;
+		case '\n': result += "\\n"; break;
+		case '\r': result += "\\r"; break;
+		case '\t': result += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				char code[8];
+				std::snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+				result += code;
+			}
+			else result += c;
+		}
+	}
+	return result;
+}
 
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-		geometryCode = gShaderStream.str();
+// 把 Shader::buildReports() 导出为 JSON，startupTime 为启动批次总耗时(ms)，不知道时传负数
+bool writeShaderBuildReport(const char* path, double startupTime) {
+	std::ofstream file(path);
+	if (!file) {
+		std::cout << "ERROR::SHADER::REPORT_NOT_WRITTEN\n" << path << std::endl;
+		return false;
 	}
-	catch (std::ifstream::failure error) {
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	const char* stageNames[] = { "vertex", "fragment", "geometry" };
+	file << "{\n  \"renderer\": \"" << jsonEscape(renderer ? renderer : "") << "\",\n";
+	file << "  \"version\": \"" << jsonEscape(version ? version : "") << "\",\n";
+	if (startupTime >= 0.0) file << "  \"startupMs\": " << startupTime << ",\n";
+	file << "  \"programs\": [";
+	const std::vector<shaderBuildReport>& reports = Shader::buildReports();
+	for (std::size_t i = 0; i < reports.size(); i++) {
+		const shaderBuildReport& report = reports[i];
+		file << (i ? "," : "") << "\n    {\n";
+		file << "      \"defines\": \"" << jsonEscape(report.defines) << "\",\n";
+		file << "      \"separable\": " << (report.separable ? "true" : "false") << ",\n";
+		file << "      \"binaryCache\": " << (report.fromBinaryCache ? "true" : "false") << ",\n";
+		file << "      \"stages\": [";
+		bool first = true;
+		for (int j = 0; j < 3; j++) {
+			const shaderStageReport& stage = report.stages[j];
+			if (!stage.present) continue;
+			file << (first ? "" : ",") << "\n        { \"type\": \"" << stageNames[j] << "\", \"path\": \"" << jsonEscape(stage.path)
+				<< "\", \"readMs\": " << stage.readTime << ", \"compileMs\": " << stage.compileTime
+				<< ", \"compiled\": " << (stage.compiled ? "true" : "false") << ", \"log\": \"" << jsonEscape(stage.infoLog) << "\" }";
+			first = false;
+		}
+		file << "\n      ],\n";
+		file << "      \"linkMs\": " << report.linkTime << ",\n";
+		file << "      \"totalMs\": " << report.totalTime << ",\n";
+		file << "      \"linked\": " << (report.linked ? "true" : "false") << ",\n";
+		file << "      \"log\": \"" << jsonEscape(report.infoLog) << "\",\n";
+		file << "      \"activeUniforms\": " << report.activeUniforms << ",\n";
+		file << "      \"activeAttributes\": " << report.activeAttributes << ",\n";
+		file << "      \"activeUniformBlocks\": " << report.activeUniformBlocks << "\n";
+		file << "    }";
 	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
-	const char* gShaderCode = geometryCode.c_str();
+	file << "\n  ]\n}\n";
+	return true;
+}
 
-	unsigned int vertex, fragment, geometry;
-	int success;
-	char infoLog[512];
+// 有 KHR_parallel_shader_compile 时不阻塞地查询，否则视为已完成（随后的状态查询会等待驱动）
+bool Shader::isBuildComplete() const {
+	if (!building || fromBinaryCache || !glExt.parallelShaderCompile) return true;
+	int complete = GL_TRUE;
+	glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete == GL_TRUE;
+}
 
-	// vertex
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATTON_FAILED\n" << infoLog << std::endl;
-	}
+// 检查编译链接结果，写缓存并建立 uniform 位置表
+void Shader::finishBuild() {
+	if (!building) return;
+	building = false;
 
-	// fragment
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	glGetShaderiv(fragment, GL_FRAGMENT_SHADER, &success);
-	if (!success) {
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROE::SHADER::FRAGMENT::COMPILATTON_FAILED\n" << infoLog << std::endl;
+	report.fromBinaryCache = fromBinaryCache;
+	if (!fromBinaryCache) {
+		int success;
+		const char* stageNames[] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+		for (int i = 0; i < 3; i++) {
+			if (!stages[i]) continue;
+			// 同步驱动在这里等待编译完成
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			glGetShaderiv(stages[i], GL_COMPILE_STATUS, &success);
+			report.stages[i].compileTime += elapsedMilliseconds(start);
+			report.stages[i].compiled = success == GL_TRUE;
+			report.stages[i].infoLog = shaderInfoLog(stages[i]);
+			if (!success)
+				std::cout << "ERROR::SHADER::" << stageNames[i] << "::COMPILATION_FAILED\n" << report.stages[i].infoLog << std::endl;
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		report.linkTime += elapsedMilliseconds(start);
+		report.infoLog = programInfoLog(ID);
+		if (!success)
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << report.infoLog << std::endl;
+		else saveProgramBinary(cacheKey);
+
+		for (unsigned int& stage : stages) {
+			if (stage) glDeleteShader(stage);
+			stage = 0;
+		}
+	}
+	else {
+		for (shaderStageReport& stage : report.stages)
+			stage.compiled = stage.present;
 	}
 
-	// geometry
-	geometry = glCreateShader(GL_GEOMETRY_SHADER);
-	glShaderSource(geometry, 1, &gShaderCode, NULL);
-	glCompileShader(geometry);
-	glGetShaderiv(geometry, GL_GEOMETRY_SHADER, &success);
-	if (!success) {
-		glGetShaderInfoLog(geometry, 512, NULL, infoLog);
-		std::cout << "ERROE::SHADER::GEOMETRY::COMPILATTON_FAILED\n" << infoLog << std::endl;
+	int linked = GL_FALSE;
+	glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+	report.linked = linked == GL_TRUE;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &report.activeUniforms);
+	glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &report.activeAttributes);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &report.activeUniformBlocks);
+
+	cacheUniformLocations();
+	for (const auto& binding : defaultBlockBindings()) {
+		unsigned int blockIndex = glGetUniformBlockIndex(ID, binding.first.c_str());
+		if (blockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, blockIndex, binding.second);
 	}
+	report.totalTime = elapsedMilliseconds(buildStart);
+	buildReports().push_back(report);
+}
+
+// 64 位 FNV-1a，键包含各阶段源码、宏与驱动信息，任一变化都会使旧缓存失效
+unsigned long long Shader::programCacheKey(const std::string* sources[], int count, const std::string& defines) {
+	unsigned long long hash = 14695981039346656037ull;
+	auto mix = [&hash](const char* data, std::size_t len) {
+		for (std::size_t i = 0; i < len; i++) {
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ull;
+		}
+		// 分隔符，避免 "ab"+"c" 与 "a"+"bc" 相同
+		hash ^= 0xff;
+		hash *= 1099511628211ull;
+	};
+	for (int i = 0; i < count; i++)
+		mix(sources[i]->c_str(), sources[i]->size());
+	mix(defines.c_str(), defines.size());
+	// 可分离程序的二进制与普通程序不通用
+	if (separable) mix("separable", 9);
+	const char* strings[] = {
+		(const char*)glGetString(GL_VENDOR),
+		(const char*)glGetString(GL_RENDERER),
+		(const char*)glGetString(GL_VERSION)
+	};
+	for (const char* str : strings)
+		if (str) mix(str, std::strlen(str));
+	return hash;
+}
+
+std::string shaderCachePath(unsigned long long key) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", key);
+	return std::string(SHADER_CACHE_DIR) + "/" + name;
+}
+
+bool Shader::loadProgramBinary(unsigned long long key) {
+	fromBinaryCache = false;
+	if (!glExt.programBinary) return false;
+
+	std::ifstream file(shaderCachePath(key), std::ios::binary);
+	if (!file) return false;
+	unsigned int magic = 0;
+	unsigned long long fileKey = 0;
+	GLenum format = 0;
+	int length = 0;
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&fileKey, sizeof(fileKey));
+	file.read((char*)&format, sizeof(format));
+	file.read((char*)&length, sizeof(length));
+	if (!file || magic != SHADER_CACHE_MAGIC || fileKey != key || length <= 0) return false;
+	std::vector<char> binary(length);
+	file.read(binary.data(), length);
+	if (!file) return false;
 
-	// shader program
 	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glAttachShader(ID, geometry);
-	glLinkProgram(ID);
+	// 与链接一样，可分离标记要在载入二进制之前设置
+	if (separable && glExt.separateShaderObjects)
+		glExt.ProgramParameteri(ID, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	glExt.ProgramBinary(ID, format, binary.data(), length);
+	int success;
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
 	if (!success) {
-		glGetProgramInfoLog(ID, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		// 驱动拒绝旧二进制（例如驱动更新），回退到完整编译，随后会覆盖缓存
+		glDeleteProgram(ID);
+		ID = 0;
+		return false;
 	}
+	fromBinaryCache = true;
+	return true;
+}
 
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-	glDeleteShader(geometry);
+void Shader::saveProgramBinary(unsigned long long key) {
+	if (!glExt.programBinary) return;
+
+	int length = 0;
+	glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glExt.GetProgramBinary(ID, length, &length, &format, binary.data());
+
+	SHADER_MKDIR(SHADER_CACHE_DIR);
+	std::ofstream file(shaderCachePath(key), std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cout << "WARNING::SHADER::BINARY_CACHE_NOT_WRITABLE" << std::endl;
+		return;
+	}
+	unsigned int magic = SHADER_CACHE_MAGIC;
+	file.write((const char*)&magic, sizeof(magic));
+	file.write((const char*)&key, sizeof(key));
+	file.write((const char*)&format, sizeof(format));
+	file.write((const char*)&length, sizeof(length));
+	file.write(binary.data(), length);
 }
 
 void Shader::use()
@@ -242,48 +688,278 @@ void Shader::use()
 	glUseProgram(ID);
 }
 
-// uniform 工具函数
+// 链接后一次性枚举 GL_ACTIVE_UNIFORMS 填表，之后渲染循环不再向驱动查询位置
+void Shader::cacheUniformLocations() {
+	uniformLookupsAvoided = 0;
+	int count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	unsigned int capacity = 16;
+	while (capacity < (unsigned int)count * 2) capacity <<= 1;
+	uniformTable.assign(capacity, uniformSlot());
+	uniformCount = 0;
+	// 重新链接或载入二进制后 uniform 回到默认值
+	uniformValues.clear();
+
+	std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+	for (int i = 0; i < count; i++) {
+		int size = 0, length = 0;
+		GLenum type;
+		glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, nameBuffer.data());
+		std::string name(nameBuffer.data(), length);
+		int location = glGetUniformLocation(ID, name.c_str());
+		if (location < 0) continue;	// uniform block 中的成员没有位置
+		int value = (int)uniformValues.size();
+		uniformValues.push_back(uniformValue());
+		insertUniformLocation(name, location, value);
+
+		// 数组以 "name[0]" 的形式返回，同时登记 "name" 与其余各元素
+		if (size > 1 && name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+			std::string base = name.substr(0, name.size() - 3);
+			insertUniformLocation(base, location, value);
+			for (int j = 1; j < size; j++) {
+				std::string element = base + "[" + std::to_string(j) + "]";
+				uniformValues.push_back(uniformValue());
+				insertUniformLocation(element, glGetUniformLocation(ID, element.c_str()), (int)uniformValues.size() - 1);
+			}
+		}
+	}
+}
+
+void Shader::insertUniformLocation(const std::string& name, int location, int value) {
+	if (location < 0) return;
+	unsigned int hash = uniformHash(name.c_str(), name.size());
+	// 负载超过一半时扩容重排
+	if ((uniformCount + 1) * 2 > uniformTable.size()) {
+		std::vector<uniformSlot> old;
+		old.swap(uniformTable);
+		uniformTable.assign(old.size() * 2, uniformSlot());
+		uniformCount = 0;
+		for (const uniformSlot& slot : old)
+			if (slot.location >= 0) insertUniformLocation(slot.name, slot.location, slot.value);
+	}
+	unsigned int mask = (unsigned int)uniformTable.size() - 1;
+	unsigned int i = hash & mask;
+	bool collided = false;
+	while (uniformTable[i].location >= 0) {
+		if (uniformTable[i].name == name) return;
+		// 句柄只带哈希，撞车时无法区分：两者都不再按句柄解析
+		if (uniformTable[i].hash == hash) {
+			std::cout << "WARNING::SHADER::UNIFORM_HASH_COLLISION\n" << uniformTable[i].name << " / " << name << std::endl;
+			uniformTable[i].collided = true;
+			collided = true;
+		}
+		i = (i + 1) & mask;
+	}
+	uniformTable[i].hash = hash;
+	uniformTable[i].location = location;
+	uniformTable[i].value = value;
+	uniformTable[i].collided = collided;
+	uniformTable[i].name = name;
+	uniformCount++;
+}
+
+const uniformSlot* Shader::findUniform(const std::string& name) const {
+	uniformLookupsAvoided++;
+	unsigned int hash = uniformHash(name.c_str(), name.size());
+	unsigned int mask = (unsigned int)uniformTable.size() - 1;
+	unsigned int i = hash & mask;
+	while (uniformTable[i].location >= 0) {
+		if (uniformTable[i].hash == hash && uniformTable[i].name == name)
+			return &uniformTable[i];
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+const uniformSlot* Shader::findUniform(UniformHandle handle) const {
+	uniformLookupsAvoided++;
+	unsigned int mask = (unsigned int)uniformTable.size() - 1;
+	unsigned int i = handle.hash & mask;
+	while (uniformTable[i].location >= 0) {
+		if (uniformTable[i].hash == handle.hash) {
+			// 撞车的句柄不解析到任何一个 uniform，写入被丢弃，调用方须改用按名字的重载
+			if (uniformTable[i].collided) {
+				std::cout << "ERROR::SHADER::HANDLE_COLLISION " << uniformTable[i].name << std::endl;
+				return NULL;
+			}
+			return &uniformTable[i];
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+// 与 glGetUniformLocation 一致，不存在的 uniform 返回 -1，glUniform* 会忽略
+int Shader::getUniformLocation(const std::string& name) const {
+	const uniformSlot* slot = findUniform(name);
+	return slot ? slot->location : -1;
+}
+
+int Shader::getUniformLocation(UniformHandle handle) const {
+	const uniformSlot* slot = findUniform(handle);
+	return slot ? slot->location : -1;
+}
+
+void Shader::setUniformCaching(const std::string& name, bool enabled) {
+	const uniformSlot* slot = findUniform(name);
+	if (!slot) return;
+	uniformValues[slot->value].tracked = enabled;
+	uniformValues[slot->value].valid = false;
+}
+
+void Shader::setUniformCaching(UniformHandle handle, bool enabled) {
+	const uniformSlot* slot = findUniform(handle);
+	if (!slot) return;
+	uniformValues[slot->value].tracked = enabled;
+	uniformValues[slot->value].valid = false;
+}
+
+void Shader::invalidateUniformCache() const {
+	for (uniformValue& value : uniformValues)
+		value.valid = false;
+}
+
+uniformWriteStats& Shader::writeStats() {
+	static uniformWriteStats stats;
+	return stats;
+}
+
+bool Shader::updateUniformValue(const uniformSlot* slot, const void* data, unsigned int size) const {
+	// 不存在的 uniform，写入本来就会被忽略
+	if (!slot) return false;
+	uniformValue& value = uniformValues[slot->value];
+	if (size > sizeof(value.data)) {
+		// 一次写多个数组元素，会覆盖其他位置记录的值
+		invalidateUniformCache();
+		writeStats().issued++;
+		return true;
+	}
+	if (value.tracked && value.valid && value.size == size && std::memcmp(value.data, data, size) == 0) {
+		writeStats().skipped++;
+		return false;
+	}
+	if (value.tracked) {
+		std::memcpy(value.data, data, size);
+		value.size = size;
+		value.valid = true;
+	}
+	writeStats().issued++;
+	return true;
+}
+
+// uniform 工具函数，值与上次写入相同时跳过
 void Shader::setBool(const std::string& name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	const uniformSlot* slot = findUniform(name);
+	int data = (int)value;
+	if (updateUniformValue(slot, &data, sizeof(data)))
+		glUniform1i(slot->location, data);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	const uniformSlot* slot = findUniform(name);
+	if (updateUniformValue(slot, &value, sizeof(value)))
+		glUniform1i(slot->location, value);
 }
 
 void Shader::setFloat(const std::string& name, float value)
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	const uniformSlot* slot = findUniform(name);
+	if (updateUniformValue(slot, &value, sizeof(value)))
+		glUniform1f(slot->location, value);
 }
 
 void Shader::setVec2f(const std::string& name, float xValue, float yValue) {
-	glUniform2f(glGetUniformLocation(ID, name.c_str()), xValue, yValue);
+	setVec2f(name, glm::vec2(xValue, yValue));
 }
 
 void Shader::setVec2f(const std::string& name, glm::vec2 value) {
-	glUniform2f(glGetUniformLocation(ID, name.c_str()), value.x, value.y);
+	const uniformSlot* slot = findUniform(name);
+	if (updateUniformValue(slot, &value.x, sizeof(value)))
+		glUniform2f(slot->location, value.x, value.y);
 }
 
 void Shader::setVec3f(const std::string& name, float xValue, float yValue, float zValue) {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), xValue, yValue, zValue);
+	setVec3f(name, glm::vec3(xValue, yValue, zValue));
 }
 
 void Shader::setVec3f(const std::string& name, glm::vec3 value) {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+	const uniformSlot* slot = findUniform(name);
+	if (updateUniformValue(slot, &value.x, sizeof(value)))
+		glUniform3f(slot->location, value.x, value.y, value.z);
 }
 
 void Shader::setMat4f(const std::string& name, int count, GLfloat* value) {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), count, GL_FALSE, value);
+	const uniformSlot* slot = findUniform(name);
+	if (updateUniformValue(slot, value, sizeof(GLfloat) * 16 * count))
+		glUniformMatrix4fv(slot->location, count, GL_FALSE, value);
 }
 
 void Shader::setMat4f(const std::string& name, GLfloat* value, int count = 1) {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), count, GL_FALSE, value);
+	setMat4f(name, count, value);
 }
 
 void Shader::setMat4f(const std::string& name, glm::mat4 value, int count = 1) {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), count, GL_FALSE, glm::value_ptr(value));
+	setMat4f(name, count, glm::value_ptr(value));
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const
+{
+	const uniformSlot* slot = findUniform(handle);
+	int data = (int)value;
+	if (updateUniformValue(slot, &data, sizeof(data)))
+		glUniform1i(slot->location, data);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const
+{
+	const uniformSlot* slot = findUniform(handle);
+	if (updateUniformValue(slot, &value, sizeof(value)))
+		glUniform1i(slot->location, value);
+}
+
+void Shader::setFloat(UniformHandle handle, float value)
+{
+	const uniformSlot* slot = findUniform(handle);
+	if (updateUniformValue(slot, &value, sizeof(value)))
+		glUniform1f(slot->location, value);
+}
+
+void Shader::setVec2f(UniformHandle handle, float xValue, float yValue) {
+	setVec2f(handle, glm::vec2(xValue, yValue));
+}
+
+void Shader::setVec2f(UniformHandle handle, glm::vec2 value) {
+	const uniformSlot* slot = findUniform(handle);
+	if (updateUniformValue(slot, &value.x, sizeof(value)))
+		glUniform2f(slot->location, value.x, value.y);
+}
+
+void Shader::setVec3f(UniformHandle handle, float xValue, float yValue, float zValue) {
+	setVec3f(handle, glm::vec3(xValue, yValue, zValue));
+}
+
+void Shader::setVec3f(UniformHandle handle, glm::vec3 value) {
+	const uniformSlot* slot = findUniform(handle);
+	if (updateUniformValue(slot, &value.x, sizeof(value)))
+		glUniform3f(slot->location, value.x, value.y, value.z);
+}
+
+void Shader::setMat4f(UniformHandle handle, int count, GLfloat* value) {
+	const uniformSlot* slot = findUniform(handle);
+	if (updateUniformValue(slot, value, sizeof(GLfloat) * 16 * count))
+		glUniformMatrix4fv(slot->location, count, GL_FALSE, value);
+}
+
+void Shader::setMat4f(UniformHandle handle, GLfloat* value, int count) {
+	setMat4f(handle, count, value);
+}
+
+void Shader::setMat4f(UniformHandle handle, glm::mat4 value, int count) {
+	setMat4f(handle, count, glm::value_ptr(value));
 }
 
 // unifromBuffer 工具函数
@@ -292,6 +968,20 @@ void Shader::uniformBlockBinding(const std::string& name, unsigned int index) {
 	glUniformBlockBinding(ID, block_index, index);
 }
 
+std::vector<std::pair<std::string, unsigned int> >& Shader::defaultBlockBindings() {
+	static std::vector<std::pair<std::string, unsigned int> > bindings;
+	return bindings;
+}
+
+void Shader::defaultBlockBinding(const std::string& name, unsigned int index) {
+	for (auto& binding : defaultBlockBindings())
+		if (binding.first == name) {
+			binding.second = index;
+			return;
+		}
+	defaultBlockBindings().push_back(std::make_pair(name, index));
+}
+
 unsigned int UniformBufferManager::createUniformBuffer(GLsizeiptr size, GLenum usage) {
 	unsigned int uboID;
 	glGenBuffers(1, &uboID);
@@ -299,162 +989,246 @@ unsigned int UniformBufferManager::createUniformBuffer(GLsizeiptr size, GLenum u
 	glBufferData(GL_UNIFORM_BUFFER, size, NULL, usage);
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 	index = 0;
+	shadow.assign((std::size_t)size, 0);
+	dirtyBegin = UINT_MAX;
+	dirtyEnd = 0;
+	uploadCount = 0;
 	return uboID;
 }
 
-void UniformBufferManager::uniformBufferBinding(unsigned index) {
-	glBindBufferBase(GL_UNIFORM_BUFFER, index, ID);
-}
+UniformBufferManager::UniformBufferManager(const Shader& shader, const std::string& blockName, GLenum usage) {
+	reflected = true;
+	unsigned int blockIndex = glGetUniformBlockIndex(shader.ID, blockName.c_str());
+	if (blockIndex == GL_INVALID_INDEX) {
+		std::cout << "ERROR::UNIFORMBUFFER::BLOCK_NOT_FOUND\n" << blockName << std::endl;
+		ID = createUniformBuffer(0, usage);
+		return;
+	}
+	int dataSize = 0, count = 0;
+	glGetActiveUniformBlockiv(shader.ID, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+	glGetActiveUniformBlockiv(shader.ID, blockIndex, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+	ID = createUniformBuffer(dataSize, usage);
+	if (count <= 0) return;
 
-void UniformBufferManager::setUniformBufferBool(const std::string& name, int value) {
-	glBindBuffer(GL_UNIFORM_BUFFER, ID);
-	if (!uniformBufferStruct->count(name)) {
-		glBufferSubData(GL_UNIFORM_BUFFER, index, 4, &value);
-		(*uniformBufferStruct)[name] = uniformStruct(4, index);
-		index += 4;
+	std::vector<int> indices(count);
+	glGetActiveUniformBlockiv(shader.ID, blockIndex, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+	std::vector<GLuint> uniformIndices(indices.begin(), indices.end());
+	std::vector<int> offsets(count), arrayStrides(count), matrixStrides(count), sizes(count);
+	glGetActiveUniformsiv(shader.ID, count, uniformIndices.data(), GL_UNIFORM_OFFSET, offsets.data());
+	glGetActiveUniformsiv(shader.ID, count, uniformIndices.data(), GL_UNIFORM_ARRAY_STRIDE, arrayStrides.data());
+	glGetActiveUniformsiv(shader.ID, count, uniformIndices.data(), GL_UNIFORM_MATRIX_STRIDE, matrixStrides.data());
+	glGetActiveUniformsiv(shader.ID, count, uniformIndices.data(), GL_UNIFORM_SIZE, sizes.data());
+
+	char name[256];
+	for (int i = 0; i < count; i++) {
+		int length = 0;
+		glGetActiveUniformName(shader.ID, uniformIndices[i], sizeof(name), &length, name);
+		std::string uniformName(name, length);
+		// 带实例名的块成员为 "Block.member"，按成员名登记
+		std::size_t prefix = blockName.size() + 1;
+		if (uniformName.compare(0, prefix, blockName + ".") == 0)
+			uniformName = uniformName.substr(prefix);
+
+		uniformStruct uniform(0, offsets[i]);
+		uniform.matrixStride = matrixStrides[i];
+		uniform.hash = uniformHash(uniformName.c_str(), uniformName.size());
+		bool isArray = sizes[i] > 1 && uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0;
+		if (isArray) {
+			uniform.arrayStride = arrayStrides[i];
+			uniform.arraySize = sizes[i];
+		}
+		addUniform(uniform);
+		// 数组同时登记 "name" 与每个 "name[i]"
+		if (isArray) {
+			std::string base = uniformName.substr(0, uniformName.size() - 3);
+			uniform.hash = uniformHash(base.c_str(), base.size());
+			addUniform(uniform);
+			uniform.arrayStride = 0;
+			uniform.arraySize = 0;
+			for (int j = 1; j < sizes[i]; j++) {
+				std::string element = base + "[" + std::to_string(j) + "]";
+				uniform.offset = offsets[i] + j * arrayStrides[i];
+				uniform.hash = uniformHash(element.c_str(), element.size());
+				addUniform(uniform);
+			}
+		}
 	}
-	else {
-		unsigned int base = (*uniformBufferStruct)[name].base;
-		unsigned int offset = (*uniformBufferStruct)[name].offset;
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, base, &value);
+}
+
+const uniformStruct* UniformBufferManager::findUniform(unsigned int hash) const {
+	auto it = std::lower_bound(layout.begin(), layout.end(), hash,
+		[](const uniformStruct& uniform, unsigned int value) { return uniform.hash < value; });
+	if (it == layout.end() || it->hash != hash) return NULL;
+	return &*it;
+}
+
+void UniformBufferManager::addUniform(const uniformStruct& uniform) {
+	auto it = std::lower_bound(layout.begin(), layout.end(), uniform.hash,
+		[](const uniformStruct& entry, unsigned int value) { return entry.hash < value; });
+	if (it != layout.end() && it->hash == uniform.hash) {
+		std::cout << "WARNING::UNIFORMBUFFER::UNIFORM_HASH_COLLISION" << std::endl;
+		return;
 	}
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	layout.insert(it, uniform);
 }
 
-void UniformBufferManager::setUniformBufferInt(const std::string name, int value) {
-	glBindBuffer(GL_UNIFORM_BUFFER, ID);
-	if (!uniformBufferStruct->count(name)) {
-		glBufferSubData(GL_UNIFORM_BUFFER, index, 4, &value);
-		(*uniformBufferStruct)[name] = uniformStruct(4, index);
-		index += 4;
+unsigned int UniformBufferManager::resolveOffset(const std::string& name, unsigned int size, unsigned int align) {
+	unsigned int hash = uniformHash(name.c_str(), name.size());
+	const uniformStruct* uniform = findUniform(hash);
+	if (uniform) return uniform->offset;
+	if (reflected) return UINT_MAX;
+
+	// 按调用顺序追加，对齐到 align 的整数倍
+	unsigned int cur = index;
+	if (cur % align != 0) cur = cur + align - (cur % align);
+	uniformStruct entry(size, cur);
+	entry.hash = hash;
+	addUniform(entry);
+	index = cur + size;
+	return cur;
+}
+
+const uniformStruct* UniformBufferManager::resolveArray(const std::string& name, unsigned int stride, unsigned int count) {
+	unsigned int hash = uniformHash(name.c_str(), name.size());
+	const uniformStruct* uniform = findUniform(hash);
+	if (uniform && uniform->arrayStride) return uniform;
+	if (reflected) return NULL;
+	if (uniform) {
+		// 之前按单个变量登记过：其后的成员紧挨着它排布，原位扩成数组会与它们重叠
+		std::cout << "ERROR::UNIFORMBUFFER::ARRAY_REDECLARED " << name << " was set as a single value before" << std::endl;
+		return NULL;
+	}
+
+	// 数组起始对齐到 16，整段占 count 个步长
+	unsigned int cur = (index + 15) / 16 * 16;
+	uniformStruct entry(16, cur);
+	entry.hash = hash;
+	entry.arrayStride = stride;
+	entry.arraySize = count;
+	addUniform(entry);
+	// 同时登记各元素，按名字单独写某个元素仍然可用
+	for (unsigned int i = 0; i < count; i++) {
+		std::string element = name + "[" + std::to_string(i) + "]";
+		uniformStruct item(16, cur + i * stride);
+		item.hash = uniformHash(element.c_str(), element.size());
+		addUniform(item);
 	}
+	index = cur + stride * count;
+	return findUniform(hash);
+}
+
+void UniformBufferManager::write(unsigned int offset, const void* data, unsigned int size) {
+	if (offset == UINT_MAX || offset + size > shadow.size()) return;
+	std::memcpy(&shadow[offset], data, size);
+	markDirty(offset, size);
+}
+
+void UniformBufferManager::markDirty(unsigned int offset, unsigned int size) {
+	if (offset < dirtyBegin) dirtyBegin = offset;
+	if (offset + size > dirtyEnd) dirtyEnd = offset + size;
+}
+
+template <class T>
+void UniformBufferManager::setUniformBufferArray(const std::string& name, const T* values, unsigned int count) {
+	if (count == 0) return;
+	const uniformStruct* uniform = resolveArray(name, Std140<std::array<T, 1> >::stride(), count);
+	if (!uniform) return;
+	if (count > uniform->arraySize) count = uniform->arraySize;
+	unsigned int stride = uniform->arrayStride;
+	unsigned int size = stride * (count - 1) + Std140<T>::size();
+	if (uniform->offset + size > shadow.size()) return;
+
+	unsigned char* dst = &shadow[uniform->offset];
+	// vec4、mat4 这类与 std140 完全一致的类型整段拷贝
+	if (stride == sizeof(T) && Std140<T>::size() == sizeof(T))
+		std::memcpy(dst, values, size);
 	else {
-		unsigned int base = (*uniformBufferStruct)[name].base;
-		unsigned int offset = (*uniformBufferStruct)[name].offset;
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, base, &value);
+		for (unsigned int i = 0; i < count; i++)
+			Std140<T>::write(dst + i * stride, values[i]);
 	}
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	markDirty(uniform->offset, size);
 }
 
-void UniformBufferManager::setUniformBufferIntArray(const std::string name, unsigned int size, int value[]) {
-	for (int i = 0; i < size; i++) {
-		setUniformBufferInt(name + "[" + std::to_string(i) + "]", value[i]);
-		if (index % 16 != 0)
-			index = index + 16 - (index % 16);
+template <class... Ts>
+void UniformBufferManager::setUniformBlock(const Std140Block<Ts...>& block) {
+	if (block.size() > shadow.size()) {
+		std::cout << "ERROR::UNIFORMBUFFER::BLOCK_SIZE_MISMATCH " << block.size() << " > " << shadow.size() << std::endl;
+		return;
 	}
+	write(0, block.data(), block.size());
 }
 
-void UniformBufferManager::setUniformBufferFloat(const std::string name, float value) {
+void UniformBufferManager::flush() {
+	if (dirtyBegin >= dirtyEnd) return;
 	glBindBuffer(GL_UNIFORM_BUFFER, ID);
-	if (!uniformBufferStruct->count(name)) {
-		glBufferSubData(GL_UNIFORM_BUFFER, index, 4, &value);
-		(*uniformBufferStruct)[name] = uniformStruct(4, index);
-		index += 4;
-	}
-	else {
-		unsigned int base = (*uniformBufferStruct)[name].base;
-		unsigned int offset = (*uniformBufferStruct)[name].offset;
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, base, &value);
-	}
+	glBufferSubData(GL_UNIFORM_BUFFER, dirtyBegin, dirtyEnd - dirtyBegin, &shadow[dirtyBegin]);
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	uploadCount++;
+	dirtyBegin = UINT_MAX;
+	dirtyEnd = 0;
+}
+
+void UniformBufferManager::uniformBufferBinding(unsigned index) {
+	glBindBufferBase(GL_UNIFORM_BUFFER, index, ID);
+}
+
+// 以下写入只更新影子缓冲，需调用 flush() 上传
+void UniformBufferManager::setUniformBufferBool(const std::string& name, int value) {
+	write(resolveOffset(name, 4, 4), &value, 4);
+}
+
+void UniformBufferManager::setUniformBufferInt(const std::string name, int value) {
+	write(resolveOffset(name, 4, 4), &value, 4);
+}
+
+void UniformBufferManager::setUniformBufferIntArray(const std::string name, unsigned int size, int value[]) {
+	setUniformBufferArray(name, value, size);
+}
+
+void UniformBufferManager::setUniformBufferFloat(const std::string name, float value) {
+	write(resolveOffset(name, 4, 4), &value, 4);
 }
 
 void UniformBufferManager::setUniformBufferFloatArray(const std::string name, unsigned int size, float value[]) {
-	for (int i = 0; i < size; i++) {
-		setUniformBufferFloat(name + "[" + std::to_string(i) + "]", value[i]);
-		if (index % 16 != 0)
-			index = index + 16 - (index % 16);
-	}
+	setUniformBufferArray(name, value, size);
 }
 
 void UniformBufferManager::setUniformBufferVec2f(const std::string name, glm::vec2 value) {
 	float data[] = { value.x, value.y };
-	glBindBuffer(GL_UNIFORM_BUFFER, ID);
-	if (!uniformBufferStruct->count(name)) {
-		// 必须是16的倍数，对(*curUniformBufferIndex)取16的整数倍
-		unsigned int cur;
-		if (index % 16 == 0) cur = index;
-		else cur = index + 16 - (index % 16);
-
-		glBufferSubData(GL_UNIFORM_BUFFER, cur, 8, &data);
-		(*uniformBufferStruct)[name] = uniformStruct(8, cur);
-		index = cur + 8;
-	}
-	else {
-		unsigned int base = (*uniformBufferStruct)[name].base;
-		unsigned int offset = (*uniformBufferStruct)[name].offset;
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, base, &data);
-	}
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	// 必须是16的倍数，对index取16的整数倍
+	write(resolveOffset(name, 8, 16), data, 8);
 }
 
 void UniformBufferManager::setUniformBufferVec2fArray(const std::string name, unsigned int size, glm::vec2 value[]) {
-	for (int i = 0; i < size; i++) {
-		setUniformBufferVec2f(name + "[" + std::to_string(i) + "]", value[i]);
-		if (index % 16 != 0)
-			index = index + 16 - (index % 16);
-	}
+	setUniformBufferArray(name, value, size);
 }
 
 void UniformBufferManager::setUniformBufferVec3f(const std::string name, glm::vec3 value) {
 	float data[] = { value.x, value.y, value.z };
-	glBindBuffer(GL_UNIFORM_BUFFER, ID);
-	if (!uniformBufferStruct->count(name)) {
-		// 必须是16的倍数，对(*curUniformBufferIndex)取16的整数倍
-		unsigned int cur;
-		if (index % 16 == 0) cur = index;
-		else cur = index + 16 - (index % 16);
-
-		glBufferSubData(GL_UNIFORM_BUFFER, cur, 12, &data);
-		(*uniformBufferStruct)[name] = uniformStruct(12, cur);
-		index = cur + 12;
-	}
-	else {
-		unsigned int base = (*uniformBufferStruct)[name].base;
-		unsigned int offset = (*uniformBufferStruct)[name].offset;
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, base, &data);
-	}
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	write(resolveOffset(name, 12, 16), data, 12);
 }
 
 void UniformBufferManager::setUniformBufferVec3fArray(const std::string name, unsigned int size, glm::vec3 value[]) {
-	for (int i = 0; i < size; i++) {
-		setUniformBufferVec3f(name + "[" + std::to_string(i) + "]", value[i]);
-		if (index % 16 != 0)
-			index = index + 16 - (index % 16);
-	}
+	setUniformBufferArray(name, value, size);
 }
 
 void UniformBufferManager::setUniformBufferVec4f(const std::string name, glm::vec4 value) {
 	float data[] = { value.x, value.y, value.z, value.w };
-	glBindBuffer(GL_UNIFORM_BUFFER, ID);
-	if (!uniformBufferStruct->count(name)) {
-		// 必须是16的倍数，对(*curUniformBufferIndex)取16的整数倍
-		unsigned int cur;
-		if (index % 16 == 0) cur = index;
-		else cur = index + 16 - (index % 16);
-
-		glBufferSubData(GL_UNIFORM_BUFFER, cur, 16, &data);
-		(*uniformBufferStruct)[name] = uniformStruct(16, cur);
-		index = cur + 16;
-	}
-	else {
-		unsigned int base = (*uniformBufferStruct)[name].base;
-		unsigned int offset = (*uniformBufferStruct)[name].offset;
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, base, &data);
-	}
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	write(resolveOffset(name, 16, 16), data, 16);
 }
 
 void UniformBufferManager::setUniformBufferVec4fArray(const std::string name, unsigned int size, glm::vec4 value[]) {
-	for (int i = 0; i < size; i++) {
-		setUniformBufferVec4f(name + "[" + std::to_string(i) + "]", value[i]);
-		if (index % 16 != 0)
-			index = index + 16 - (index % 16);
-	}
+	setUniformBufferArray(name, value, size);
 }
 
 void UniformBufferManager::setUniformBufferMat3f(const std::string name, glm::mat3 value) {
+	// 反射布局中矩阵按列步长写入
+	const uniformStruct* uniform = findUniform(uniformHash(name.c_str(), name.size()));
+	if (uniform && uniform->matrixStride) {
+		for (int i = 0; i < 3; i++)
+			write(uniform->offset + i * uniform->matrixStride, &value[i].x, 12);
+		return;
+	}
 	// 矩阵算数组，在他之后的第一个变量的偏移地址应该是下一个16的倍数
 	for (int i = 0; i < 3; i++) {
 		glm::vec3 row = value[i];
@@ -465,6 +1239,12 @@ void UniformBufferManager::setUniformBufferMat3f(const std::string name, glm::ma
 }
 
 void UniformBufferManager::setUniformBufferMat4f(const std::string name, glm::mat4 value) {
+	const uniformStruct* uniform = findUniform(uniformHash(name.c_str(), name.size()));
+	if (uniform && uniform->matrixStride) {
+		for (int i = 0; i < 4; i++)
+			write(uniform->offset + i * uniform->matrixStride, &value[i].x, 16);
+		return;
+	}
 	// 矩阵算数组，在他之后的第一个变量的偏移地址应该是下一个16的倍数
 	for (int i = 0; i < 4; i++) {
 		glm::vec4 row = value[i];
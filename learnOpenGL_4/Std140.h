@@ -0,0 +1,149 @@
+#ifndef STD140_H
+#define STD140_H
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <tuple>
+#include <cstring>
+#include <cstddef>
+
+// 编译期 std140 布局
+// Std140<T> 给出类型的基准对齐量与大小，Std140Block<Ts...> 按成员顺序算出偏移并持有整块数据，
+// 整块可以一次 memcpy / glBufferSubData 上传，不再需要手工补齐和按名字查表
+// 用法：
+//   typedef Std140Block<glm::mat4, glm::vec3, float> LightBlock;
+//   enum { LIGHT_VIEW, LIGHT_COLOR, LIGHT_RANGE };
+//   static_assert(LightBlock::offset(LIGHT_RANGE) == 76, "");
+//   block.set<LIGHT_COLOR>(glm::vec3(1.f));
+
+constexpr unsigned int std140RoundUp(unsigned int value, unsigned int align) {
+	return (value + align - 1) / align * align;
+}
+
+template <class T>
+struct Std140 {
+	static_assert(sizeof(T) == 0, "type has no std140 mapping");
+};
+
+// 标量：对齐 4，bool 按 4 字节整数存放
+template <class T>
+struct Std140Scalar {
+	static constexpr unsigned int align() { return 4; }
+	static constexpr unsigned int size() { return 4; }
+	static void write(unsigned char* dst, const T& value) { std::memcpy(dst, &value, 4); }
+};
+template <> struct Std140<float> : Std140Scalar<float> {};
+template <> struct Std140<int> : Std140Scalar<int> {};
+template <> struct Std140<unsigned int> : Std140Scalar<unsigned int> {};
+template <> struct Std140<bool> : Std140Scalar<int> {
+	static void write(unsigned char* dst, const bool& value) {
+		int data = value ? 1 : 0;
+		std::memcpy(dst, &data, 4);
+	}
+};
+
+// 向量：vec2 对齐 8，vec3/vec4 对齐 16
+template <> struct Std140<glm::vec2> {
+	static constexpr unsigned int align() { return 8; }
+	static constexpr unsigned int size() { return 8; }
+	static void write(unsigned char* dst, const glm::vec2& value) { std::memcpy(dst, &value.x, 8); }
+};
+template <> struct Std140<glm::vec3> {
+	static constexpr unsigned int align() { return 16; }
+	static constexpr unsigned int size() { return 12; }
+	static void write(unsigned char* dst, const glm::vec3& value) { std::memcpy(dst, &value.x, 12); }
+};
+template <> struct Std140<glm::vec4> {
+	static constexpr unsigned int align() { return 16; }
+	static constexpr unsigned int size() { return 16; }
+	static void write(unsigned char* dst, const glm::vec4& value) { std::memcpy(dst, &value.x, 16); }
+};
+
+// 矩阵按列主序存放，每列占一个 vec4
+template <> struct Std140<glm::mat3> {
+	static constexpr unsigned int align() { return 16; }
+	static constexpr unsigned int size() { return 48; }
+	static void write(unsigned char* dst, const glm::mat3& value) {
+		for (int i = 0; i < 3; i++)
+			std::memcpy(dst + i * 16, &value[i].x, 12);
+	}
+};
+template <> struct Std140<glm::mat4> {
+	static constexpr unsigned int align() { return 16; }
+	static constexpr unsigned int size() { return 64; }
+	static void write(unsigned char* dst, const glm::mat4& value) {
+		for (int i = 0; i < 4; i++)
+			std::memcpy(dst + i * 16, &value[i].x, 16);
+	}
+};
+
+// 数组：元素步长向上取整到 16
+template <class T, std::size_t N>
+struct Std140<std::array<T, N> > {
+	static_assert(N > 0, "std140 array must not be empty");
+	static constexpr unsigned int stride() { return std140RoundUp(Std140<T>::size(), 16); }
+	static constexpr unsigned int align() { return 16; }
+	static constexpr unsigned int size() { return stride() * (unsigned int)N; }
+	static void write(unsigned char* dst, const std::array<T, N>& value) {
+		for (std::size_t i = 0; i < N; i++)
+			Std140<T>::write(dst + i * stride(), value[i]);
+	}
+};
+
+template <class... Ts>
+class Std140Block {
+	static_assert(sizeof...(Ts) > 0, "std140 block must have members");
+public:
+	template <unsigned int I>
+	using member = typename std::tuple_element<I, std::tuple<Ts...> >::type;
+
+	static constexpr unsigned int count() { return sizeof...(Ts); }
+	// 第 index 个成员的偏移
+	static constexpr unsigned int offset(unsigned int index) {
+		const unsigned int aligns[] = { Std140<Ts>::align()... };
+		const unsigned int sizes[] = { Std140<Ts>::size()... };
+		unsigned int cur = 0;
+		for (unsigned int i = 0; i < index; i++)
+			cur = std140RoundUp(cur, aligns[i]) + sizes[i];
+		return std140RoundUp(cur, aligns[index]);
+	}
+	// 整块大小，结构体对齐到 vec4
+	static constexpr unsigned int size() {
+		const unsigned int sizes[] = { Std140<Ts>::size()... };
+		return std140RoundUp(offset(count() - 1) + sizes[count() - 1], 16);
+	}
+
+	Std140Block() { std::memset(bytes, 0, sizeof(bytes)); }
+
+	template <unsigned int I>
+	void set(const member<I>& value) {
+		static_assert(I < sizeof...(Ts), "std140 member index out of range");
+		Std140<member<I> >::write(bytes + offset(I), value);
+	}
+
+	const unsigned char* data() const { return bytes; }
+
+private:
+	alignas(16) unsigned char bytes[size()];
+};
+
+// 块可以作为另一个块的成员（结构体），对齐 16
+template <class... Ts>
+struct Std140<Std140Block<Ts...> > {
+	static constexpr unsigned int align() { return 16; }
+	static constexpr unsigned int size() { return Std140Block<Ts...>::size(); }
+	static void write(unsigned char* dst, const Std140Block<Ts...>& value) {
+		std::memcpy(dst, value.data(), size());
+	}
+};
+
+// 布局规则自检
+static_assert(Std140Block<float, glm::vec3>::offset(1) == 16, "vec3 aligns to 16");
+static_assert(Std140Block<glm::vec3, float>::offset(1) == 12, "scalar packs after vec3");
+static_assert(Std140Block<float, glm::vec2>::offset(1) == 8, "vec2 aligns to 8");
+static_assert(Std140Block<float, std::array<float, 2>, float>::offset(2) == 48, "array stride rounds to 16");
+static_assert(Std140Block<glm::mat3, float>::offset(1) == 48, "mat3 columns are vec4");
+static_assert(Std140Block<glm::mat4, glm::mat4>::size() == 128, "two mat4");
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef TRANSFORMBATCH_H
+#define TRANSFORMBATCH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORMBATCH_SSE
+#endif
+
+// 批量 TRS -> 世界矩阵与法线矩阵
+// 输入按分量分开存放(SoA)，一次处理 8 个(AVX) / 4 个(SSE) 物体，余下的走标量
+// AVX 路径需要 /arch:AVX（__AVX__），工程只在 Release|x64 打开；Debug 与 Win32 走 SSE，TRANSFORMBATCH_PATH 报告实际路径
+// 法线矩阵取仿射变换左上 3x3 的余子式矩阵除以行列式，等于其逆的转置，不需要通用 4x4 求逆
+
+// 各分量一条数组
+struct transformSoA {
+	std::vector<float> px, py, pz;
+	std::vector<float> qx, qy, qz, qw;
+	std::vector<float> sx, sy, sz;
+
+	unsigned int size() const { return (unsigned int)px.size(); }
+	void resize(unsigned int count);
+	void set(unsigned int i, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+};
+
+// 按编译选项选择向量宽度，标量版本同时用于处理尾部；FrustumCulling.h 与 ClusteredLighting.h 也使用这组通道
+struct scalarLane {
+	typedef float type;
+	static const unsigned int width = 1;
+	static type load(const float* p) { return *p; }
+	static void store(float* p, type v) { *p = v; }
+	static type set1(float v) { return v; }
+	static type add(type a, type b) { return a + b; }
+	static type sub(type a, type b) { return a - b; }
+	static type mul(type a, type b) { return a * b; }
+	static type div(type a, type b) { return a / b; }
+	static type minimum(type a, type b) { return a < b ? a : b; }
+	static type maximum(type a, type b) { return a > b ? a : b; }
+	static type squareRoot(type a) { return std::sqrt(a); }
+};
+
+#if defined(__AVX__)
+struct simdLane {
+	typedef __m256 type;
+	static const unsigned int width = 8;
+	static type load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, type v) { _mm256_storeu_ps(p, v); }
+	static type set1(float v) { return _mm256_set1_ps(v); }
+	static type add(type a, type b) { return _mm256_add_ps(a, b); }
+	static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+	static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+	static type div(type a, type b) { return _mm256_div_ps(a, b); }
+	static type minimum(type a, type b) { return _mm256_min_ps(a, b); }
+	static type maximum(type a, type b) { return _mm256_max_ps(a, b); }
+	static type squareRoot(type a) { return _mm256_sqrt_ps(a); }
+};
+#define TRANSFORMBATCH_PATH "AVX"
+#elif defined(TRANSFORMBATCH_SSE)
+struct simdLane {
+	typedef __m128 type;
+	static const unsigned int width = 4;
+	static type load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, type v) { _mm_storeu_ps(p, v); }
+	static type set1(float v) { return _mm_set1_ps(v); }
+	static type add(type a, type b) { return _mm_add_ps(a, b); }
+	static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+	static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+	static type div(type a, type b) { return _mm_div_ps(a, b); }
+	static type minimum(type a, type b) { return _mm_min_ps(a, b); }
+	static type maximum(type a, type b) { return _mm_max_ps(a, b); }
+	static type squareRoot(type a) { return _mm_sqrt_ps(a); }
+};
+#define TRANSFORMBATCH_PATH "SSE"
+#else
+typedef scalarLane simdLane;
+#define TRANSFORMBATCH_PATH "scalar"
+#endif
+
+// 从 first 开始的 L::width 个物体
+template <class L>
+void composeTransformLanes(const transformSoA& in, unsigned int first, glm::mat4* world, glm::mat4* normal) {
+	typedef typename L::type V;
+	const V one = L::set1(1.f), two = L::set1(2.f);
+	V x = L::load(&in.qx[first]), y = L::load(&in.qy[first]), z = L::load(&in.qz[first]), w = L::load(&in.qw[first]);
+	V xx = L::mul(x, x), yy = L::mul(y, y), zz = L::mul(z, z);
+	V xy = L::mul(x, y), xz = L::mul(x, z), yz = L::mul(y, z);
+	V wx = L::mul(w, x), wy = L::mul(w, y), wz = L::mul(w, z);
+
+	// 旋转矩阵各列乘以对应缩放，m[c][r] 为第 c 列第 r 行
+	V sx = L::load(&in.sx[first]), sy = L::load(&in.sy[first]), sz = L::load(&in.sz[first]);
+	V m[3][3];
+	m[0][0] = L::mul(L::sub(one, L::mul(two, L::add(yy, zz))), sx);
+	m[0][1] = L::mul(L::mul(two, L::add(xy, wz)), sx);
+	m[0][2] = L::mul(L::mul(two, L::sub(xz, wy)), sx);
+	m[1][0] = L::mul(L::mul(two, L::sub(xy, wz)), sy);
+	m[1][1] = L::mul(L::sub(one, L::mul(two, L::add(xx, zz))), sy);
+	m[1][2] = L::mul(L::mul(two, L::add(yz, wx)), sy);
+	m[2][0] = L::mul(L::mul(two, L::add(xz, wy)), sz);
+	m[2][1] = L::mul(L::mul(two, L::sub(yz, wx)), sz);
+	m[2][2] = L::mul(L::sub(one, L::mul(two, L::add(xx, yy))), sz);
+
+	// 余子式矩阵的列：c0 = m1 x m2, c1 = m2 x m0, c2 = m0 x m1
+	V c[3][3];
+	for (int i = 0; i < 3; i++) {
+		const V* a = m[(i + 1) % 3];
+		const V* b = m[(i + 2) % 3];
+		c[i][0] = L::sub(L::mul(a[1], b[2]), L::mul(a[2], b[1]));
+		c[i][1] = L::sub(L::mul(a[2], b[0]), L::mul(a[0], b[2]));
+		c[i][2] = L::sub(L::mul(a[0], b[1]), L::mul(a[1], b[0]));
+	}
+	V det = L::add(L::add(L::mul(m[0][0], c[0][0]), L::mul(m[0][1], c[0][1])), L::mul(m[0][2], c[0][2]));
+	V invDet = L::div(one, det);
+
+	// 先按分量写到临时区，再散布到各物体的矩阵
+	float out[21][L::width];
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++) {
+			L::store(out[i * 3 + j], m[i][j]);
+			L::store(out[9 + i * 3 + j], L::mul(c[i][j], invDet));
+		}
+	L::store(out[18], L::load(&in.px[first]));
+	L::store(out[19], L::load(&in.py[first]));
+	L::store(out[20], L::load(&in.pz[first]));
+
+	for (unsigned int k = 0; k < L::width; k++) {
+		glm::mat4& wm = world[first + k];
+		glm::mat4& nm = normal[first + k];
+		for (int i = 0; i < 3; i++) {
+			wm[i] = glm::vec4(out[i * 3][k], out[i * 3 + 1][k], out[i * 3 + 2][k], 0.f);
+			nm[i] = glm::vec4(out[9 + i * 3][k], out[9 + i * 3 + 1][k], out[9 + i * 3 + 2][k], 0.f);
+		}
+		wm[3] = glm::vec4(out[18][k], out[19][k], out[20][k], 1.f);
+		nm[3] = glm::vec4(0.f, 0.f, 0.f, 1.f);
+	}
+}
+
+// world[i] = T * R * S，normal[i] 为其左上 3x3 逆的转置（以 mat4 存放）
+void composeTransforms(const transformSoA& in, glm::mat4* world, glm::mat4* normal) {
+	unsigned int count = in.size();
+	unsigned int i = 0;
+	for (; i + simdLane::width <= count; i += simdLane::width)
+		composeTransformLanes<simdLane>(in, i, world, normal);
+	for (; i < count; i++)
+		composeTransformLanes<scalarLane>(in, i, world, normal);
+}
+
+// 单个仿射矩阵的法线矩阵，标量版本的余子式捷径
+glm::mat4 affineNormalMatrix(const glm::mat4& m) {
+	glm::vec3 m0(m[0]), m1(m[1]), m2(m[2]);
+	glm::vec3 c0 = glm::cross(m1, m2), c1 = glm::cross(m2, m0), c2 = glm::cross(m0, m1);
+	float invDet = 1.f / glm::dot(m0, c0);
+	return glm::mat4(glm::vec4(c0 * invDet, 0.f), glm::vec4(c1 * invDet, 0.f), glm::vec4(c2 * invDet, 0.f),
+		glm::vec4(0.f, 0.f, 0.f, 1.f));
+}
+
+void transformSoA::resize(unsigned int count) {
+	std::vector<float>* components[] = { &px, &py, &pz, &qx, &qy, &qz, &qw, &sx, &sy, &sz };
+	for (std::vector<float>* component : components)
+		component->resize(count, 0.f);
+}
+
+void transformSoA::set(unsigned int i, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+	px[i] = position.x; py[i] = position.y; pz[i] = position.z;
+	qx[i] = rotation.x; qy[i] = rotation.y; qz[i] = rotation.z; qw[i] = rotation.w;
+	sx[i] = scale.x; sy[i] = scale.y; sz[i] = scale.z;
+}
+
+// 与逐物体 glm 路径（translate * mat4_cast * scale，再 transpose(inverse(model))）对比，打印耗时与最大误差
+void benchmarkTransformBatch() {
+	const unsigned int counts[] = { 1000, 10000, 100000 };
+	std::cout << "TRANSFORM::BENCHMARK path " << TRANSFORMBATCH_PATH << std::endl;
+	for (unsigned int count : counts) {
+		transformSoA in;
+		in.resize(count);
+		std::vector<glm::vec3> positions(count), scales(count);
+		std::vector<glm::quat> rotations(count);
+		unsigned int seed = 12345u;
+		auto random = [&seed]() {
+			seed = seed * 1664525u + 1013904223u;
+			return (float)(seed >> 8) / 16777216.f;
+		};
+		for (unsigned int i = 0; i < count; i++) {
+			positions[i] = glm::vec3(random() * 100.f - 50.f, random() * 100.f - 50.f, random() * 100.f - 50.f);
+			rotations[i] = glm::angleAxis(random() * 6.2831853f, glm::normalize(glm::vec3(random() - .5f, random() - .5f, random() - .5f)));
+			scales[i] = glm::vec3(.5f + random(), .5f + random(), .5f + random());
+			in.set(i, positions[i], rotations[i], scales[i]);
+		}
+		std::vector<glm::mat4> world(count), normal(count), glmWorld(count), glmNormal(count);
+
+		// 重复到至少约 100ms 取平均
+		auto measure = [](const std::function<void()>& work) {
+			unsigned int runs = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			double elapsed = 0.0;
+			do {
+				work();
+				runs++;
+				elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			} while (elapsed < 100.0);
+			return elapsed / runs;
+		};
+		double glmTime = measure([&]() {
+			for (unsigned int i = 0; i < count; i++) {
+				glm::mat4 model = glm::translate(glm::mat4(1.f), positions[i]) * glm::mat4_cast(rotations[i]);
+				model = glm::scale(model, scales[i]);
+				glmWorld[i] = model;
+				glmNormal[i] = glm::transpose(glm::inverse(model));
+			}
+		});
+		double batchTime = measure([&]() { composeTransforms(in, world.data(), normal.data()); });
+
+		float maxError = 0.f;
+		for (unsigned int i = 0; i < count; i++)
+			for (int c = 0; c < 3; c++)
+				for (int r = 0; r < 3; r++) {
+					maxError = std::fmax(maxError, std::fabs(world[i][c][r] - glmWorld[i][c][r]));
+					maxError = std::fmax(maxError, std::fabs(normal[i][c][r] - glmNormal[i][c][r]));
+				}
+		std::cout << "TRANSFORM::BENCHMARK " << count << " objects: glm " << glmTime << " ms, batch " << batchTime
+			<< " ms, x" << glmTime / batchTime << ", max error " << maxError << std::endl;
+	}
+}
+
+#endif
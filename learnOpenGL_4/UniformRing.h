@@ -0,0 +1,165 @@
+#ifndef UNIFORMRING_H
+#define UNIFORMRING_H
+
+#include <glad/glad.h>
+
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include "GLExtension.h"
+#include "Shader_s.h"
+
+// 每帧/每次绘制的 uniform 数据流式环形缓冲
+// 缓冲分成 frames 段，每帧写入一段，每次绘制的数据按 GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 对齐后用 glBindBufferRange 绑定
+// 有 ARB_buffer_storage 时持久映射、直接 memcpy，用 glFenceSync 保证 GPU 读完后才复用某一段；
+// 否则每帧孤立(orphan)整个缓冲再逐块 glBufferSubData
+class UniformRingBuffer {
+private:
+	unsigned char* mapped;
+	GLsync fences[3];
+	unsigned int frames;
+	unsigned int frame;
+	unsigned int cursor;
+	unsigned int alignment;
+	bool overflowReported;
+
+	unsigned int allocate(unsigned int size);
+public:
+	unsigned int ID;
+	unsigned int frameSize;
+	bool persistent;
+	// 本帧写入的块数与字节数
+	unsigned int blockCount;
+	unsigned int byteCount;
+
+	// frames 最多为 3
+	UniformRingBuffer(unsigned int _frameSize, unsigned int _frames = 3);
+	~UniformRingBuffer();
+
+	// 帧开始时调用，必要时等待该段的围栏
+	void beginFrame();
+	// 写入一块数据并绑定到 binding 点
+	bool bind(unsigned int binding, const void* data, unsigned int size);
+	// 以 UniformBufferManager 的影子缓冲为数据源
+	bool bind(unsigned int binding, const UniformBufferManager& block);
+	// 以编译期 std140 布局的块为数据源
+	template <class... Ts>
+	bool bind(unsigned int binding, const Std140Block<Ts...>& block) {
+		return bind(binding, block.data(), block.size());
+	}
+	// 帧结束时调用，为本段插入围栏
+	void endFrame();
+};
+
+UniformRingBuffer::UniformRingBuffer(unsigned int _frameSize, unsigned int _frames) {
+	frames = _frames < 1 ? 1 : (_frames > 3 ? 3 : _frames);
+	frame = 0;
+	cursor = 0;
+	blockCount = 0;
+	byteCount = 0;
+	mapped = NULL;
+	overflowReported = false;
+	for (GLsync& fence : fences) fence = 0;
+
+	int align = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	alignment = align > 0 ? (unsigned int)align : 256;
+	frameSize = (_frameSize + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	persistent = glExt.bufferStorage;
+	if (persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glExt.BufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)frameSize * frames, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)frameSize * frames, flags);
+		if (!mapped) {
+			// 映射失败时重建为可变存储走孤立路径
+			std::cout << "WARNING::UNIFORMRING::PERSISTENT_MAP_FAILED" << std::endl;
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			glDeleteBuffers(1, &ID);
+			glGenBuffers(1, &ID);
+			glBindBuffer(GL_UNIFORM_BUFFER, ID);
+			persistent = false;
+		}
+	}
+	if (!persistent)
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)frameSize * frames, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRingBuffer::~UniformRingBuffer() {
+	for (GLsync& fence : fences)
+		if (fence) glDeleteSync(fence);
+	if (mapped) {
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ID);
+}
+
+void UniformRingBuffer::beginFrame() {
+	cursor = 0;
+	blockCount = 0;
+	byteCount = 0;
+	if (persistent) {
+		// GPU 可能还在读这一段（frames 帧之前提交的）
+		GLsync& fence = fences[frame];
+		if (fence) {
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			while (result == GL_TIMEOUT_EXPIRED)
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+	else if (frame == 0) {
+		// 绕完一圈后孤立旧存储，驱动会另分配一块，不需要等待
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)frameSize * frames, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+}
+
+unsigned int UniformRingBuffer::allocate(unsigned int size) {
+	unsigned int offset = cursor;
+	if (offset + size > frameSize) {
+		if (!overflowReported) {
+			std::cout << "WARNING::UNIFORMRING::FRAME_OVERFLOW " << frameSize << " bytes" << std::endl;
+			overflowReported = true;
+		}
+		return UINT_MAX;
+	}
+	cursor = (offset + size + alignment - 1) / alignment * alignment;
+	return frame * frameSize + offset;
+}
+
+bool UniformRingBuffer::bind(unsigned int binding, const void* data, unsigned int size) {
+	unsigned int offset = allocate(size);
+	if (offset == UINT_MAX) return false;
+	if (persistent)
+		std::memcpy(mapped + offset, data, size);
+	else {
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, offset, size);
+	blockCount++;
+	byteCount += size;
+	return true;
+}
+
+bool UniformRingBuffer::bind(unsigned int binding, const UniformBufferManager& block) {
+	return bind(binding, block.data(), block.size());
+}
+
+void UniformRingBuffer::endFrame() {
+	if (persistent)
+		fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame = (frame + 1) % frames;
+}
+
+#endif
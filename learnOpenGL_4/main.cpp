@@ -1,13 +1,32 @@
 #include <iostream>
+#include <cstring>
+#include <random>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <stb/stb_image.h>
-#include <LearnOpenGL/shader_s.h>
+#include "Shader_s.h"
+#include "GLExtension.h"
+#include "ShaderBatch.h"
+#include "ShaderVariants.h"
+#include "UniformRing.h"
+#include "ProgramPipeline.h"
+#include "RenderQueue.h"
+#include "SceneGraph.h"
+#include "TransformBatch.h"
+#include "InstanceBatch.h"
+#include "FrustumCulling.h"
+#include "GeometryArena.h"
+#include "OcclusionCulling.h"
+#include "CommandList.h"
+#include "FramePipeline.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "GpuTimer.h"
+#include "DepthPrepass.h"
 #include <LearnOpenGL/camera.h>
-#include <LearnOpenGL/keyboard.h>
 #include <LearnOpenGL/mesh.h>
 #include <LearnOpenGL/model.h>
 #include <assimp/Importer.hpp>
@@ -23,33 +42,139 @@
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 1200;
 
+// uniform block binding points
+const unsigned int CAMERA_BLOCK_BINDING = 0;
+const unsigned int OBJECT_BLOCK_BINDING = 1;
+const unsigned int CLUSTER_BLOCK_BINDING = 2;
+
+// std140 mirror of the Camera block in shader/camera.glsl
+typedef Std140Block<glm::mat4, glm::mat4, glm::vec3> CameraBlock;
+enum CameraMember { CAMERA_PROJECTION, CAMERA_VIEW, CAMERA_VIEWPOS };
+
+// std140 mirror of the Object block in shader/object.glsl
+typedef Std140Block<glm::mat4, glm::mat4> ObjectBlock;
+enum ObjectMember { OBJECT_MODEL, OBJECT_NRMMAT };
+static_assert(ObjectBlock::offset(OBJECT_NRMMAT) == 64 && ObjectBlock::size() == 128, "Object block layout");
+
 // camera
 Camera camera(glm::vec3(0.f));
-bool firstMouse = true;
-float lastXpos = SCR_WIDTH / 2.f;
-float lastYpos = SCR_HEIGHT / 2.f;
-
-// keyboard
-Keyboard keyboard(&camera);
 
 // timing
 float deltaTime = 0.f;
 float lastTime = 0.f;
 
+// simulation: input, camera and scene transforms advance on their own thread at a fixed rate
+const double SIMULATION_TIMESTEP = 1.0 / 120.0;
+
+// GLFW delivers input on the main thread and its window functions may only be called there. The callbacks only
+// queue the raw events; the simulation thread owns the camera and all input state (held movement keys, camera
+// lock, cursor display) and hands the window changes it decides on back to the main thread
+enum InputEventType { INPUT_CURSOR, INPUT_SCROLL, INPUT_KEY };
+struct inputEvent {
+	InputEventType type;
+	double x, y;	// cursor position or scroll offset
+	int key, action;	// INPUT_KEY: GLFW key and GLFW_PRESS / GLFW_RELEASE / GLFW_REPEAT
+};
+EventQueue<inputEvent> inputEvents;
+enum windowRequest { WINDOW_CAPTURE_CURSOR, WINDOW_SHOW_CURSOR, WINDOW_CLOSE };
+EventQueue<windowRequest> windowRequests;
+// key bindings: movement in Camera_Movement order, camera lock freezes the camera, mouse display shows the cursor
+// for the menu (the camera stays still while it is shown), escape closes the window
+const int MOVEMENT_KEYS[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D };
+const int CAMERA_LOCK_KEY = GLFW_KEY_L;
+const int MOUSE_DISPLAY_KEY = GLFW_KEY_LEFT_ALT;
+
+// immutable state of one simulation tick, everything the render thread reads from the simulation
+struct frameSnapshot {
+	unsigned long long sequence;	// publish count
+	unsigned long long tick;
+	glm::vec3 cameraPosition;
+	glm::vec3 cameraFront;
+	float cameraZoom;
+	glm::mat4 view;
+	std::vector<glm::mat4> world;
+	std::vector<glm::mat4> normal;
+	std::vector<unsigned int> versions;	// per node, bumped whenever its world transform changes
+	unsigned int updatedNodes;	// nodes recomputed by the ticks since the previous snapshot
+	glm::vec3 pointLightPosition;
+	std::vector<clusterLight> lights;
+};
+
+// lighting: each enabled light selects a specialized variant of the lit shader
+enum LightFeature { LIGHT_DIR = 1 << 0, LIGHT_POINT = 1 << 1, LIGHT_SPOT = 1 << 2, LIGHT_CLUSTERED = 1 << 3 };
+bool dirLightEnable = false;
+bool pointLightEnable = true;
+bool spotLightEnable = false;
+// clustered lights: a pool animated by the simulation, the first clusteredLightCount are assigned to clusters and shaded
+const int MAX_CLUSTERED_LIGHTS = 1024;
+bool clusteredLightEnable = true;
+int clusteredLightCount = 512;
+
+// deferred shading: the room is written to a G-buffer once, then lit by screen-space passes and light volumes.
+// The deferred lighting programs are variants of one source: the light features above select the fullscreen
+// pass, DEFERRED_VOLUMES and DEFERRED_COMPOSITE the other two passes
+enum DeferredPass { DEFERRED_VOLUMES = 1 << 3, DEFERRED_COMPOSITE = 1 << 4 };
+bool deferredShadingEnable = false;
+
+// forward vs deferred benchmark, started from the Menu: every light count is rendered in both modes,
+// the first frames of each run are skipped while the timings settle
+const int BENCHMARK_LIGHTS[] = { 0, 128, 256, 512, 1024 };
+const int BENCHMARK_RUNS = 2 * (int)(sizeof(BENCHMARK_LIGHTS) / sizeof(BENCHMARK_LIGHTS[0]));
+const int BENCHMARK_WARMUP = 10;
+const int BENCHMARK_FRAMES = 60;
+
+// instancing: copies of the pointlight gizmo drawn by one InstanceBatch
+int pointlightCopies = 1;
+
+// merged geometry: erusa's submeshes share one arena and are drawn with multi-draw indirect when available
+bool mergedGeometry = true;
+
+// mesh LOD: erusa's arena meshes get simplified index ranges at load, every draw picks the coarsest level whose
+// error projects to at most lodPixelError pixels
+bool meshLodEnable = true;
+float lodPixelError = 1.f;
+
+// crowd: copies of erusa scattered over the floor, drawn as arena instances in a single submit, to measure
+// triangle throughput with and without LOD. The benchmark renders it with LOD off, then on
+const int CROWD_SIZE = 1000;
+bool crowdEnable = false;
+
+// occlusion culling: heavy objects are tested with hardware queries against the occluders drawn before them
+bool occlusionCulling = true;
+
+// depth pre-pass (forward only): opaque meshes lay down depth with a position-only program, then the lit pass
+// runs with GL_EQUAL so every pixel is shaded once. Alpha-cutout meshes skip the pre-pass and are drawn after it,
+// queueModel picks the meshes of each pass with a MeshFilter
+enum MeshFilter { MESHES_ALL, MESHES_OPAQUE, MESHES_CUTOUT };
+bool depthPrepassEnable = true;
+
 /* --------------------------------------------------- */
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double XposIn, double YposIn);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void applyWindowRequests(GLFWwindow* window);
+
+int main(int argc, char* argv[]) {
+	// --shader-startup [report.json]: build the shaders in a hidden window, report the time and exit,
+	// optionally writing the per-program build report as JSON
+	bool shaderStartupOnly = argc > 1 && std::strcmp(argv[1], "--shader-startup") == 0;
+	const char* shaderReportPath = shaderStartupOnly && argc > 2 ? argv[2] : NULL;
+	// --transform-bench: compare the batched transform kernel with the per-object glm path and exit
+	if (argc > 1 && std::strcmp(argv[1], "--transform-bench") == 0) {
+		benchmarkTransformBatch();
+		return 0;
+	}
 
-int main() {
 	// init glfwwindow config
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_SAMPLES, 4);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (shaderStartupOnly)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 	// create glfwwindow
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL4", NULL, NULL);
 	if (window == NULL) {
@@ -64,6 +189,7 @@ int main() {
 		glfwTerminate();
 		return -1;
 	}
+	loadGLExtension((GLADloadproc)glfwGetProcAddress);
 	// glfwwindow setting
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -89,85 +215,762 @@ int main() {
 		aiProcess_SortByPType
 	);
 
-	Shader lightShader("shader/3.3.only_diff.vert", "shader/3.3.only_diff.frag");
-	Shader shader("shader/3.3.shader.vert", "shader/3.3.shader.frag");
+	// shaders: submitted together and built in the background while the models load,
+	// cold start compiles, warm start loads from the program binary cache.
+	// With separate shader objects a single vertex program is shared through a program pipeline
+	// and only the fragment stage switches; otherwise every program links its own vertex stage.
+	bool usePipeline = glExt.separateShaderObjects;
+	Shader vertexProgram;
+	Shader lightShader;
+	// INSTANCED variant: the vertex stage alone with pipelines, otherwise a full program with the light fragment shader
+	Shader instancedProgram;
+	instancedProgram.separable = usePipeline;
+	// MATERIAL_ARRAY variant for the geometry arena, split the same way: vertex stage + fragment stage with pipelines
+	Shader arenaProgram;
+	Shader arenaFragment;
+	arenaProgram.separable = usePipeline;
+	arenaFragment.separable = true;
+	// deferred geometry pass, split like lightShader
+	Shader gbufferShader;
+	gbufferShader.separable = usePipeline;
+	ShaderVariants* litShaders = new ShaderVariants(usePipeline ? NULL : "shader/3.3.shader.vert", "shader/3.3.shader.frag",
+		{ "DIR_LIGHT", "POINT_LIGHT", "SPOT_LIGHT", "CLUSTERED_LIGHTS" });
+	ShaderVariants* deferredLights = new ShaderVariants("shader/deferred.vert", "shader/deferred.frag",
+		{ "DIR_LIGHT", "POINT_LIGHT", "SPOT_LIGHT", "LIGHT_VOLUMES", "COMPOSITE" });
+	Shader::defaultBlockBinding("Camera", CAMERA_BLOCK_BINDING);
+	Shader::defaultBlockBinding("Object", OBJECT_BLOCK_BINDING);
+	Shader::defaultBlockBinding("Clusters", CLUSTER_BLOCK_BINDING);
+	ShaderBatch shaderBatch;
+	shaderBatch.printReport = shaderStartupOnly;
+	if (usePipeline) {
+		vertexProgram.separable = true;
+		lightShader.separable = true;
+		shaderBatch.add(vertexProgram, "shader/3.3.shader.vert", NULL);
+		shaderBatch.add(lightShader, NULL, "shader/3.3.only_diff.frag");
+	}
+	else shaderBatch.add(lightShader, "shader/3.3.shader.vert", "shader/3.3.only_diff.frag");
+	shaderBatch.add(instancedProgram, "shader/3.3.shader.vert", usePipeline ? NULL : "shader/3.3.only_diff.frag", NULL,
+		"#define INSTANCED\n");
+	shaderBatch.add(arenaProgram, "shader/3.3.shader.vert", usePipeline ? NULL : "shader/3.3.only_diff.frag", NULL,
+		"#define MATERIAL_ARRAY\n");
+	if (usePipeline)
+		shaderBatch.add(arenaFragment, NULL, "shader/3.3.only_diff.frag", NULL, "#define MATERIAL_ARRAY\n");
+	// crowd: arena instances read their matrices from the instance buffer, paired with arenaFragment like arenaProgram
+	Shader crowdProgram;
+	crowdProgram.separable = usePipeline;
+	shaderBatch.add(crowdProgram, "shader/3.3.shader.vert", usePipeline ? NULL : "shader/3.3.only_diff.frag", NULL,
+		"#define MATERIAL_ARRAY\n#define INSTANCE_BUFFER\n");
+	Shader occlusionShader;
+	shaderBatch.add(occlusionShader, "shader/occlusion.vert", "shader/occlusion.frag");
+	shaderBatch.add(gbufferShader, usePipeline ? NULL : "shader/3.3.shader.vert", "shader/gbuffer.frag");
+	// bound with glUseProgram like occlusionShader, never part of the pipeline
+	Shader depthShader;
+	shaderBatch.add(depthShader, "shader/depth.vert", "shader/depth.frag");
+	litShaders->prepare(LIGHT_POINT, shaderBatch);
+	litShaders->prepare(LIGHT_POINT | LIGHT_CLUSTERED, shaderBatch);
+	shaderBatch.submit();
+	if (shaderStartupOnly) {
+		shaderBatch.wait();
+		if (shaderReportPath)
+			writeShaderBuildReport(shaderReportPath, shaderBatch.buildTime);
+		delete litShaders;
+		delete deferredLights;
+		glDeleteProgram(vertexProgram.ID);
+		glDeleteProgram(lightShader.ID);
+		glDeleteProgram(instancedProgram.ID);
+		glDeleteProgram(arenaProgram.ID);
+		glDeleteProgram(arenaFragment.ID);
+		glDeleteProgram(crowdProgram.ID);
+		glDeleteProgram(occlusionShader.ID);
+		glDeleteProgram(gbufferShader.ID);
+		glDeleteProgram(depthShader.ID);
+		glfwTerminate();
+		return 0;
+	}
 
 	Model* floor = new Model("model/room/floor.obj");
 	Model* erusa = new Model("model/erusa/erusa01.pmx");
 	Model* pointlight = new Model("model/pointlight/pointlight.obj");
+	// local-space bounds of every mesh, computed once after loading
+	std::vector<boundingVolume> floorBounds = computeModelBounds(*floor);
+	std::vector<boundingVolume> erusaBounds = computeModelBounds(*erusa);
+	std::vector<boundingVolume> pointlightBounds = computeModelBounds(*pointlight);
+	boundingVolume pointlightModelBounds = mergeBounds(pointlightBounds);
+	// erusa's submeshes suballocated into shared vertex/index buffers, diffuse textures in one texture array
+	GeometryArena* sceneArena = new GeometryArena();
+	unsigned int erusaArenaMesh = sceneArena->addModel(*erusa);
+	sceneArena->buildLods(erusaArenaMesh, (unsigned int)erusa->meshes.size());
+	sceneArena->upload();
+	// without the texture array the arena cannot draw: erusa goes through its own meshes and there is no crowd
+	if (!sceneArena->ready) mergedGeometry = false;
+
+	// per-draw data: laid out by the Object block, streamed through a triple-buffered ring
+	UniformRingBuffer* objectRing = new UniformRingBuffer(64 * 1024);
+	ObjectBlock objectBlock;
+	CameraBlock cameraBlock;
+	RenderQueue renderQueue;
+	InstanceBatch* pointlightBatch = new InstanceBatch(*pointlight);
+	boundingVolume pointlightBatchBounds = pointlightModelBounds;
+	// culling and queueing are recorded per part of the scene on worker threads, then replayed here
+	FrustumCuller roomCuller;
+	FrustumCuller heavyCuller;
+	CommandList roomCommands;
+	CommandList heavyCommands;
+	// with the depth pre-pass each part also records its depth-only draws and its alpha-cutout meshes
+	CommandList roomPrepassCommands;
+	CommandList roomCutoutCommands;
+	CommandList heavyPrepassCommands;
+	CommandList heavyCutoutCommands;
+	CommandRecorder* commandRecorder = new CommandRecorder();
+	// heavy objects are drawn after the occluders, behind an occlusion test
+	RenderQueue heavyQueue;
+	OcclusionCuller* occlusionCuller = new OcclusionCuller(occlusionShader);
+	unsigned int erusaOcclusion = occlusionCuller->addObject("erusa");
+	boundingVolume erusaModelBounds = mergeBounds(erusaBounds);
+	// crowd: fixed copies at random spots and headings on the floor, scaled like erusaNode
+	std::vector<glm::mat4> crowdWorld, crowdNormal;
+	std::vector<boundingVolume> crowdBounds;
+	{
+		boundingVolume room = mergeBounds(floorBounds);
+		std::mt19937 random(1000);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		for (int i = 0; i < CROWD_SIZE; i++) {
+			glm::vec3 position(room.min.x + (room.max.x - room.min.x) * unit(random), 0.f,
+				room.min.z + (room.max.z - room.min.z) * unit(random));
+			glm::mat4 world = glm::translate(glm::mat4(1.f), position);
+			world = glm::rotate(world, glm::radians(360.f * unit(random)), glm::vec3(0.f, 1.f, 0.f));
+			world = glm::scale(world, glm::vec3(.1f));
+			crowdWorld.push_back(world);
+			crowdNormal.push_back(affineNormalMatrix(world));
+			crowdBounds.push_back(transformBounds(erusaModelBounds, world));
+		}
+	}
+	FrustumCuller crowdCuller;
+	GpuTimer* crowdTimer = new GpuTimer();
+	unsigned int crowdDrawn = 0;
+	unsigned int crowdTriangles = 0;
+	unsigned int crowdLodMeshes[GeometryArena::MAX_LODS] = { 0 };
+	// clustered lighting: near / far match the projection below
+	ClusteredLighting* clusteredLighting = new ClusteredLighting(.1f, 100.f);
+	DeferredShading* deferredShading = new DeferredShading();
+	// GPU time of the lit room: the forward draw, or the G-buffer, lighting and composite passes
+	GpuTimer* sceneTimer = new GpuTimer();
+	// alpha-cutout meshes of each model, found once from their diffuse textures
+	DepthPrepass* depthPrepass = new DepthPrepass();
+	std::vector<bool> floorCutout, erusaCutout;
+	unsigned int cutoutMeshes = 0;
+	for (const Mesh& mesh : floor->meshes) {
+		floorCutout.push_back(depthPrepass->cutout(mesh));
+		cutoutMeshes += floorCutout.back();
+	}
+	for (const Mesh& mesh : erusa->meshes) {
+		erusaCutout.push_back(depthPrepass->cutout(mesh));
+		cutoutMeshes += erusaCutout.back();
+	}
+	// the pre-pass binds its program directly, commands replayed into it bypass the pipeline
+	auto useDepthProgram = [](Shader& program) { program.use(); };
+
+	// scene: transforms are cached and only recomputed when a node (or an ancestor) moves
+	SceneGraph sceneGraph;
+	unsigned int floorNode = sceneGraph.createNode();
+	unsigned int pointlightNode = sceneGraph.createNode();
+	unsigned int erusaNode = sceneGraph.createNode();
+	sceneGraph.setLocal(floorNode, glm::vec3(0.f), glm::angleAxis(glm::radians(0.f), glm::vec3(1.f, 0.f, 0.f)), glm::vec3(1.f));
+	sceneGraph.setLocal(pointlightNode, glm::vec3(1.f, 1.f, 0.f), glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(.01f));
+	sceneGraph.setLocal(erusaNode, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(.1f));
+
+	ProgramPipeline* pipeline = usePipeline ? new ProgramPipeline() : NULL;
+	bool pipelineValidated = false;
+	// makes program current for drawing: swaps the pipeline's fragment stage, or binds the whole program
+	auto useProgram = [&pipeline](Shader& program) {
+		if (pipeline) {
+			pipeline->useStages(GL_FRAGMENT_SHADER_BIT, program);
+			pipeline->activeProgram(program);
+		}
+		else program.use();
+	};
 
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_MULTISAMPLE);
 	glEnable(GL_CULL_FACE);
-	glm::mat4 model;
-	glm::mat4 normal;
 
 	// Ʊ
 	camera.position = glm::vec3(2.5f, 1.5f, -1.5f);
 	camera.front = glm::vec3(-.83f, -.34f, .45f);
 
+	// simulation: from here on camera and sceneGraph belong to the simulation thread. Each tick applies
+	// the queued input and updates the scene; after catching up it publishes a snapshot into a triple buffer,
+	// and the render loop draws the newest one without ever waiting for the simulation
+	TripleBuffer<frameSnapshot> snapshots;
+	std::vector<unsigned int> nodeVersions(sceneGraph.size(), 0);
+	std::vector<inputEvent> pendingInput;
+	bool heldMoves[4] = { false, false, false, false };	// indexed by Camera_Movement
+	bool cameraLocked = false;
+	bool cursorShown = false;
+	bool firstCursor = true;
+	double lastCursorX = 0.0;
+	double lastCursorY = 0.0;
+	unsigned long long simulationTick = 0;
+	unsigned long long snapshotSequence = 0;
+	unsigned int updatedNodes = 0;
+	double simulationTime = 0.0;
+	// clustered light pool: every light circles its own anchor above the floor, every fourth one is a spot light
+	// pointing down. The floor node sits at the origin, so its local bounds are the room's
+	std::vector<clusterLight> roomLights(MAX_CLUSTERED_LIGHTS);
+	std::vector<glm::vec4> lightOrbits(MAX_CLUSTERED_LIGHTS);	// anchor x, anchor z, orbit radius, angular speed
+	{
+		boundingVolume room = mergeBounds(floorBounds);
+		std::mt19937 random(2586);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		for (int i = 0; i < MAX_CLUSTERED_LIGHTS; i++) {
+			clusterLight& light = roomLights[i];
+			bool spot = i % 4 == 3;
+			float x = room.min.x + (room.max.x - room.min.x) * unit(random);
+			float z = room.min.z + (room.max.z - room.min.z) * unit(random);
+			lightOrbits[i] = glm::vec4(x, z, .1f + .3f * unit(random), 2.f * unit(random) - 1.f);
+			light.position = glm::vec3(x, room.min.y + (spot ? 1.2f : .1f + .6f * unit(random)), z);
+			light.radius = spot ? 2.f : .4f + .6f * unit(random);
+			light.color = glm::vec3(unit(random), unit(random), unit(random)) * .8f;
+			light.direction = glm::vec3(0.f, -1.f, 0.f);
+			light.cosInner = spot ? glm::cos(glm::radians(20.f)) : -1.f;
+			light.cosOuter = spot ? glm::cos(glm::radians(30.f)) : -2.f;
+		}
+	}
+	auto simulate = [&](double dt) {
+		pendingInput.clear();
+		inputEvents.drain(pendingInput);
+		// while the camera is locked or the cursor is shown (for the menu) the camera neither turns, zooms nor moves.
+		// The cursor position is tracked regardless so that the camera does not jump when it is released again
+		for (const inputEvent& event : pendingInput) {
+			bool cameraFree = !cameraLocked && !cursorShown;
+			if (event.type == INPUT_CURSOR) {
+				if (firstCursor) {
+					lastCursorX = event.x;
+					lastCursorY = event.y;
+					firstCursor = false;
+				}
+				float xoffset = (float)(event.x - lastCursorX);
+				float yoffset = (float)(lastCursorY - event.y);	// window y grows downwards
+				lastCursorX = event.x;
+				lastCursorY = event.y;
+				if (cameraFree) camera.processMouseMovement(xoffset, yoffset);
+			}
+			else if (event.type == INPUT_SCROLL) {
+				if (cameraFree) camera.processMouseScroll((float)event.y);
+			}
+			else {
+				for (int i = 0; i < 4; i++)
+					if (event.key == MOVEMENT_KEYS[i] && event.action != GLFW_REPEAT) heldMoves[i] = event.action == GLFW_PRESS;
+				if (event.action != GLFW_PRESS) continue;
+				if (event.key == CAMERA_LOCK_KEY) cameraLocked = !cameraLocked;
+				else if (event.key == MOUSE_DISPLAY_KEY) {
+					cursorShown = !cursorShown;
+					windowRequests.push(cursorShown ? WINDOW_SHOW_CURSOR : WINDOW_CAPTURE_CURSOR);
+				}
+				else if (event.key == GLFW_KEY_ESCAPE) windowRequests.push(WINDOW_CLOSE);
+			}
+		}
+		// held keys move the camera by the fixed step
+		if (!cameraLocked && !cursorShown)
+			for (int i = 0; i < 4; i++)
+				if (heldMoves[i]) camera.processKeyboard((Camera_Movement)i, (float)dt);
+
+		simulationTime += dt;
+		for (int i = 0; i < MAX_CLUSTERED_LIGHTS; i++) {
+			const glm::vec4& orbit = lightOrbits[i];
+			float angle = (float)simulationTime * orbit.w + (float)i;
+			roomLights[i].position.x = orbit.x + orbit.z * glm::cos(angle);
+			roomLights[i].position.z = orbit.y + orbit.z * glm::sin(angle);
+		}
+
+		sceneGraph.update();
+		updatedNodes += sceneGraph.updatedCount;
+		for (unsigned int i = 0; i < sceneGraph.size(); i++)
+			if (sceneGraph.changed(i)) nodeVersions[i]++;
+		simulationTick++;
+	};
+	auto publishSnapshot = [&]() {
+		frameSnapshot& snapshot = snapshots.writeBuffer();
+		snapshot.sequence = ++snapshotSequence;
+		snapshot.tick = simulationTick;
+		snapshot.cameraPosition = camera.position;
+		snapshot.cameraFront = camera.front;
+		snapshot.cameraZoom = camera.zoom;
+		snapshot.view = camera.getViewMatrix();
+		snapshot.world.resize(sceneGraph.size());
+		snapshot.normal.resize(sceneGraph.size());
+		for (unsigned int i = 0; i < sceneGraph.size(); i++) {
+			snapshot.world[i] = sceneGraph.world(i);
+			snapshot.normal[i] = sceneGraph.normalMatrix(i);
+		}
+		snapshot.versions = nodeVersions;
+		snapshot.updatedNodes = updatedNodes;
+		snapshot.pointLightPosition = glm::vec3(sceneGraph.world(pointlightNode)[3]);
+		snapshot.lights = roomLights;
+		updatedNodes = 0;
+		snapshots.publish();
+	};
+	// the first snapshot is published before the thread starts, so the render loop always has one
+	simulate(0.0);
+	publishSnapshot();
+	FixedStepThread* simulation = new FixedStepThread(SIMULATION_TIMESTEP, simulate, publishSnapshot);
+	simulation->start();
+	unsigned long long lastSequence = 0;
+	unsigned long long snapshotsSkipped = 0;
+	unsigned int pointlightBatchVersion = 0;
+	// benchmark state: run index (-1 when idle), frame within the run, sums over the run,
+	// per light count the forward GPU / frame time then the deferred ones, and the settings to restore
+	int benchmarkRun = -1;
+	int benchmarkFrame = 0;
+	double benchmarkGpuTime = 0.0;
+	double benchmarkFrameTime = 0.0;
+	std::vector<double> benchmarkResults;
+	bool benchmarkSaved[2] = { false, false };
+	int benchmarkSavedCount = 0;
+	// LOD benchmark state: run 0 full detail, run 1 with LOD; per run the crowd's GPU ms, frame ms and triangles
+	int lodBenchmarkRun = -1;
+	int lodBenchmarkFrame = 0;
+	double lodBenchmarkSums[3] = { 0.0, 0.0, 0.0 };
+	std::vector<double> lodBenchmarkResults;
+	bool lodBenchmarkSaved[2] = { false, false };
+
 	while (!glfwWindowShouldClose(window)) {
 		// timing
 		float curTime = static_cast<float>(glfwGetTime());
 		deltaTime = curTime - lastTime;
 		lastTime = curTime;
 
-		// input
-		keyboard.processInput(window, deltaTime);
+		// simulation state: the newest snapshot, or the previous one again if no tick finished since the last frame
+		if (snapshots.acquire()) {
+			const frameSnapshot& fresh = snapshots.readBuffer();
+			snapshotsSkipped += fresh.sequence - lastSequence - 1;
+			lastSequence = fresh.sequence;
+		}
+		const frameSnapshot& frame = snapshots.readBuffer();
+
+		if (benchmarkRun >= 0) {
+			clusteredLightEnable = true;
+			clusteredLightCount = BENCHMARK_LIGHTS[benchmarkRun / 2];
+			deferredShadingEnable = benchmarkRun % 2 == 1;
+		}
+		if (lodBenchmarkRun >= 0) {
+			crowdEnable = true;
+			meshLodEnable = lodBenchmarkRun == 1;
+		}
 
 		// render init
 		glClearColor(0.f, 0.f, 0.f, 1.f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// keep the window responsive until every program has finished linking
+		if (!shaderBatch.poll()) {
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+			applyWindowRequests(window);
+			continue;
+		}
+		// once everything is linked: every vertex/fragment pairing the frame draws with must have matching interfaces
+		if (pipeline && !pipelineValidated) {
+			struct { Shader* vertex; Shader* fragment; } pairings[] = {
+				{ &vertexProgram, &lightShader }, { &vertexProgram, &litShaders->get(LIGHT_POINT) },
+				{ &vertexProgram, &gbufferShader }, { &instancedProgram, &lightShader }, { &arenaProgram, &arenaFragment },
+				{ &crowdProgram, &arenaFragment } };
+			for (auto& pairing : pairings) {
+				pipeline->useStages(GL_VERTEX_SHADER_BIT, *pairing.vertex);
+				pipeline->useStages(GL_FRAGMENT_SHADER_BIT, *pairing.fragment);
+				pipeline->validate();
+			}
+			pipelineValidated = true;
+		}
+
+		objectRing->beginFrame();
+		Shader::resetWriteStats();
+
+		// camera: uploaded once, read by every program through the Camera block
+		glm::mat4 projection = glm::perspective(glm::radians(frame.cameraZoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+		const glm::mat4& view = frame.view;
+		cameraBlock.set<CAMERA_PROJECTION>(projection);
+		cameraBlock.set<CAMERA_VIEW>(view);
+		cameraBlock.set<CAMERA_VIEWPOS>(frame.cameraPosition);
+		objectRing->bind(CAMERA_BLOCK_BINDING, cameraBlock);
+		// clustered lights: assigned to the cluster grid of this frame's view and uploaded before any draw.
+		// Deferred light volumes read the lights directly and need no assignment
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		if (clusteredLightEnable && deferredShadingEnable)
+			clusteredLighting->uploadLights(frame.lights.data(), (unsigned int)clusteredLightCount);
+		else if (clusteredLightEnable) {
+			clusteredLighting->update(frame.lights.data(), (unsigned int)clusteredLightCount, view, projection,
+				framebufferWidth, framebufferHeight);
+			objectRing->bind(CLUSTER_BLOCK_BINDING, clusteredLighting->block);
+		}
+		if (pipeline) {
+			pipeline->bind();
+			pipeline->useStages(GL_VERTEX_SHADER_BIT, vertexProgram);
+		}
+
 		// render
-		shader.use();
-		glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.getViewMatrix();
-		shader.setMat4f("projection", 1, glm::value_ptr(projection));
-		shader.setMat4f("view", 1, glm::value_ptr(view));
-		shader.setVec3f("viewPos", camera.position);
-		shader.setFloat("material.shininess", 32.f);
-
-		// lighting
-		shader.setBool("pointLight.enable", 1);
-		shader.setVec3f("pointLight.position", glm::vec3(1.f, 1.f, 0.f));
-		shader.setVec3f("pointLight.ambient", .1f, .1f, .1f);
-		shader.setVec3f("pointLight.diffuse", .5f, .5f, .5f);
-		shader.setVec3f("pointLight.specular", 1.f, 1.f, 1.f);
-		shader.setFloat("pointLight.constant", 1.f);
-		shader.setFloat("pointLight.linear", .09f);
-		shader.setFloat("pointLight.quadratic", .032f);
-
-		// model: floor
-		model = glm::mat4(1.f);
-		normal = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.f, 0.f, 0.f));
-		model = glm::scale(model, glm::vec3(1.f));
-		model = glm::rotate(model, glm::radians(0.f), glm::vec3(1.f, 0.f, 0.f));
-		normal = glm::transpose(glm::inverse(model));
-		shader.setMat4f("model", 1, glm::value_ptr(model));
-		shader.setMat4f("nrmMat", 1, glm::value_ptr(normal));
-		floor->Draw(shader);
-		
-		// model: light
-		lightShader.use();
-		lightShader.setMat4f("projection", 1, glm::value_ptr(projection));
-		lightShader.setMat4f("view", 1, glm::value_ptr(view));
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(1.f, 1.f, 0.f));
-		model = glm::scale(model, glm::vec3(.01f));
-		lightShader.setMat4f("model", 1, glm::value_ptr(model));
-		pointlight->Draw(lightShader);
-
-		// model: erusa
-		model = glm::mat4(1.0f);
-		normal = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.f));
-		model = glm::scale(model, glm::vec3(.1f));
-		normal = glm::transpose(glm::inverse(model));
-		lightShader.setMat4f("model", 1, glm::value_ptr(model));
-		lightShader.setMat4f("nrmMat", 1, glm::value_ptr(normal));
-		erusa->Draw(lightShader);
+		unsigned int lightFeatures = (dirLightEnable ? LIGHT_DIR : 0) | (pointLightEnable ? LIGHT_POINT : 0) | (spotLightEnable ? LIGHT_SPOT : 0) |
+			(clusteredLightEnable ? LIGHT_CLUSTERED : 0);
+		Shader& shader = litShaders->get(lightFeatures);
+		// the room is drawn with the lit program, or into the G-buffer
+		Shader& roomProgram = deferredShadingEnable ? gbufferShader : shader;
+
+		// lighting: the same uniforms feed the forward program and the deferred fullscreen pass
+		auto setLights = [&](Shader& program) {
+			program.setFloat("material.shininess"_u, 32.f);
+			if (dirLightEnable) {
+				program.setVec3f("dirLight.direction"_u, -.2f, -1.f, -.3f);
+				program.setVec3f("dirLight.ambient"_u, .05f, .05f, .05f);
+				program.setVec3f("dirLight.diffuse"_u, .4f, .4f, .4f);
+				program.setVec3f("dirLight.specular"_u, .5f, .5f, .5f);
+			}
+			if (pointLightEnable) {
+				program.setVec3f("pointLights[0].position"_u, frame.pointLightPosition);
+				program.setVec3f("pointLights[0].ambient"_u, .1f, .1f, .1f);
+				program.setVec3f("pointLights[0].diffuse"_u, .5f, .5f, .5f);
+				program.setVec3f("pointLights[0].specular"_u, 1.f, 1.f, 1.f);
+				program.setFloat("pointLights[0].constant"_u, 1.f);
+				program.setFloat("pointLights[0].linear"_u, .09f);
+				program.setFloat("pointLights[0].quadratic"_u, .032f);
+			}
+			if (spotLightEnable) {
+				program.setVec3f("spotLight.position"_u, frame.cameraPosition);
+				program.setVec3f("spotLight.direction"_u, frame.cameraFront);
+				program.setVec3f("spotLight.ambient"_u, 0.f, 0.f, 0.f);
+				program.setVec3f("spotLight.diffuse"_u, 1.f, 1.f, 1.f);
+				program.setVec3f("spotLight.specular"_u, 1.f, 1.f, 1.f);
+				program.setFloat("spotLight.cutOff"_u, glm::cos(glm::radians(12.5f)));
+				program.setFloat("spotLight.outerCutOff"_u, glm::cos(glm::radians(15.f)));
+			}
+		};
+		if (!deferredShadingEnable) {
+			useProgram(shader);
+			if (clusteredLightEnable) clusteredLighting->bind(shader);
+			setLights(shader);
+		}
+
+		// pointlight gizmos: a grid of copies around the light, rebuilt only when the node or the count changes
+		if (frame.versions[pointlightNode] != pointlightBatchVersion || pointlightBatch->size() != (unsigned int)pointlightCopies) {
+			pointlightBatchVersion = frame.versions[pointlightNode];
+			pointlightBatch->clear();
+			unsigned int side = (unsigned int)std::ceil(std::sqrt((float)pointlightCopies));
+			for (int i = 0; i < pointlightCopies; i++) {
+				glm::vec3 offset(.25f * (float)(i % side), 0.f, .25f * (float)(i / side));
+				glm::mat4 world = frame.world[pointlightNode];
+				world[3] += glm::vec4(offset, 0.f);
+				pointlightBatch->add(world, frame.normal[pointlightNode]);
+				boundingVolume bounds = transformBounds(pointlightModelBounds, world);
+				pointlightBatchBounds = i == 0 ? bounds : mergeBounds(pointlightBatchBounds, bounds);
+			}
+		}
+
+		// record: each part of the scene is culled, queued, sorted and packed into its own command list on a
+		// worker thread; only the replay below touches GL
+		frustumPlanes frustum = extractFrustumPlanes(projection * view);
+		auto cullModel = [&](FrustumCuller& culler, const std::vector<boundingVolume>& bounds, unsigned int node) {
+			for (const boundingVolume& mesh : bounds)
+				culler.add(transformBounds(mesh, frame.world[node]));
+		};
+		// queues the meshes of object that passed culling and the filter, their boxes start at box
+		auto queueModel = [&](RenderQueue& queue, const FrustumCuller& culler, unsigned int box, Model& object, Shader& program,
+			unsigned int node, const std::vector<bool>& cutout, MeshFilter filter) {
+			ObjectBlock block;
+			block.set<OBJECT_MODEL>(frame.world[node]);
+			block.set<OBJECT_NRMMAT>(frame.normal[node]);
+			float depth = -(view * frame.world[node][3]).z;
+			for (unsigned int i = 0; i < object.meshes.size(); i++)
+				if (culler.visible(box + i) && (filter == MESHES_ALL || cutout[i] == (filter == MESHES_CUTOUT)))
+					queue.add(PASS_OPAQUE, program, object.meshes[i], depth, block);
+		};
+		// the G-buffer already shades each pixel once, the pre-pass only pays off for forward shading
+		bool prepass = depthPrepassEnable && !deferredShadingEnable;
+		MeshFilter litMeshes = prepass ? MESHES_OPAQUE : MESHES_ALL;
+		unsigned int pointlightBox = 0;
+		std::vector<std::function<void()> > recordJobs;
+		// room: the floor and the gizmo batch. The lit list is recorded last so renderQueue.stats describe it
+		recordJobs.push_back([&]() {
+			roomCuller.clear();
+			cullModel(roomCuller, floorBounds, floorNode);
+			pointlightBox = roomCuller.add(pointlightBatchBounds);
+			roomCuller.cull(frustum);
+			roomPrepassCommands.clear();
+			roomCutoutCommands.clear();
+			if (prepass) {
+				renderQueue.clear();
+				queueModel(renderQueue, roomCuller, 0, *floor, depthShader, floorNode, floorCutout, MESHES_OPAQUE);
+				renderQueue.record(roomPrepassCommands, OBJECT_BLOCK_BINDING);
+				renderQueue.clear();
+				queueModel(renderQueue, roomCuller, 0, *floor, shader, floorNode, floorCutout, MESHES_CUTOUT);
+				renderQueue.record(roomCutoutCommands, OBJECT_BLOCK_BINDING);
+			}
+			renderQueue.clear();
+			queueModel(renderQueue, roomCuller, 0, *floor, roomProgram, floorNode, floorCutout, litMeshes);
+			roomCommands.clear();
+			renderQueue.record(roomCommands, OBJECT_BLOCK_BINDING);
+		});
+		// heavy: erusa, replayed later behind its occlusion test
+		recordJobs.push_back([&]() {
+			heavyCuller.clear();
+			cullModel(heavyCuller, erusaBounds, erusaNode);
+			heavyCuller.cull(frustum);
+			heavyCommands.clear();
+			heavyPrepassCommands.clear();
+			heavyCutoutCommands.clear();
+			if (mergedGeometry) return;
+			if (prepass) {
+				heavyQueue.clear();
+				queueModel(heavyQueue, heavyCuller, 0, *erusa, depthShader, erusaNode, erusaCutout, MESHES_OPAQUE);
+				heavyQueue.record(heavyPrepassCommands, OBJECT_BLOCK_BINDING);
+				heavyQueue.clear();
+				queueModel(heavyQueue, heavyCuller, 0, *erusa, lightShader, erusaNode, erusaCutout, MESHES_CUTOUT);
+				heavyQueue.record(heavyCutoutCommands, OBJECT_BLOCK_BINDING);
+			}
+			heavyQueue.clear();
+			queueModel(heavyQueue, heavyCuller, 0, *erusa, lightShader, erusaNode, erusaCutout, litMeshes);
+			heavyQueue.record(heavyCommands, OBJECT_BLOCK_BINDING);
+		});
+		// crowd: culling only, the copies are drawn through the arena below
+		recordJobs.push_back([&]() {
+			crowdCuller.clear();
+			if (!crowdEnable) return;
+			for (const boundingVolume& bounds : crowdBounds)
+				crowdCuller.add(bounds);
+			crowdCuller.cull(frustum);
+		});
+		commandRecorder->run(recordJobs);
+		depthPrepass->beginFrame();
+		if (prepass) {
+			// depth pre-pass, floor first: erusa's occlusion test below reads this depth
+			depthPrepass->beginDepth();
+			depthPrepass->beginCount(SAMPLES_PREPASS);
+			replayCommandList(roomPrepassCommands, *objectRing, useDepthProgram);
+			depthPrepass->endCount();
+			if (pipeline) {
+				pipeline->bind();
+				pipeline->useStages(GL_VERTEX_SHADER_BIT, vertexProgram);
+			}
+		}
+		else {
+			sceneTimer->begin();
+			if (deferredShadingEnable) {
+				deferredShading->beginGeometry(framebufferWidth, framebufferHeight);
+				replayCommandList(roomCommands, *objectRing, useProgram);
+				deferredShading->beginLighting();
+				glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+				unsigned int screenLights = lightFeatures & (LIGHT_DIR | LIGHT_POINT | LIGHT_SPOT);
+				if (screenLights) {
+					Shader& program = deferredLights->get(screenLights);
+					program.use();
+					deferredShading->bindTextures(program);
+					program.setMat4f("inverseViewProjection"_u, inverseViewProjection);
+					setLights(program);
+					deferredShading->drawFullscreen();
+				}
+				if (clusteredLightEnable) {
+					Shader& program = deferredLights->get(DEFERRED_VOLUMES);
+					program.use();
+					deferredShading->bindTextures(program);
+					clusteredLighting->bind(program);
+					program.setMat4f("inverseViewProjection"_u, inverseViewProjection);
+					program.setFloat("material.shininess"_u, 32.f);
+					deferredShading->drawVolumes(program, (unsigned int)clusteredLightCount);
+				}
+				deferredShading->endLighting();
+				Shader& composite = deferredLights->get(DEFERRED_COMPOSITE);
+				composite.use();
+				deferredShading->composite(composite);
+				// the deferred programs are bound with glUseProgram, which overrides the pipeline
+				if (pipeline) {
+					pipeline->bind();
+					pipeline->useStages(GL_VERTEX_SHADER_BIT, vertexProgram);
+				}
+			}
+			else {
+				depthPrepass->beginCount(SAMPLES_SHADED);
+				replayCommandList(roomCommands, *objectRing, useProgram);
+				depthPrepass->endCount();
+			}
+			sceneTimer->end();
+		}
+
+		// occlusion: erusa's box is tested against the depth drawn so far. Last frame's answer decides whether
+		// it is submitted at all, this frame's query lets the GPU skip it through conditional rendering
+		bool erusaInFrustum = heavyCuller.drawn > 0;
+		bool drawErusa = erusaInFrustum;
+		if (occlusionCulling && erusaInFrustum) {
+			occlusionCuller->beginTests();
+			drawErusa = occlusionCuller->test(erusaOcclusion, transformBounds(erusaModelBounds, frame.world[erusaNode]),
+				frame.cameraPosition, .1f);
+			occlusionCuller->endTests();
+			// the box program is bound with glUseProgram, which overrides the pipeline
+			if (pipeline) {
+				pipeline->bind();
+				pipeline->useStages(GL_VERTEX_SHADER_BIT, vertexProgram);
+			}
+		}
+		// screen-space error: pixels covered by one model-space unit of an object at the near side of its world
+		// bounds. LOD errors are model-space distances, so the object's scale is folded in
+		float pixelsPerRadian = framebufferHeight / (2.f * glm::tan(glm::radians(frame.cameraZoom) * .5f));
+		auto pixelsPerUnit = [&](const glm::mat4& world, const boundingVolume& worldBounds) {
+			float distance = glm::length(worldBounds.center - frame.cameraPosition) - worldBounds.radius;
+			return glm::length(glm::vec3(world[0])) * pixelsPerRadian / (distance > .1f ? distance : .1f);
+		};
+		auto meshLod = [&](unsigned int mesh, float pixels) {
+			return meshLodEnable ? sceneArena->selectLod(mesh, pixels, lodPixelError) : 0u;
+		};
+		// the same for every pass of the frame, GL_EQUAL after the pre-pass needs identical triangles
+		float erusaPixels = pixelsPerUnit(frame.world[erusaNode], transformBounds(erusaModelBounds, frame.world[erusaNode]));
+		// erusa's meshes selected by filter: its recorded commands, or the merged arena meshes with one Object
+		// block for the model and every visible submesh in one submit. depth draws them with the pre-pass program
+		auto drawErusaMeshes = [&](const CommandList& commands, MeshFilter filter, bool depth) {
+			if (occlusionCulling) occlusionCuller->beginConditional(erusaOcclusion);
+			if (mergedGeometry) {
+				for (unsigned int i = 0; i < erusa->meshes.size(); i++)
+					if (heavyCuller.visible(i) && (filter == MESHES_ALL || erusaCutout[i] == (filter == MESHES_CUTOUT)))
+						sceneArena->queue(erusaArenaMesh + i, meshLod(erusaArenaMesh + i, erusaPixels));
+				objectBlock.set<OBJECT_MODEL>(frame.world[erusaNode]);
+				objectBlock.set<OBJECT_NRMMAT>(frame.normal[erusaNode]);
+				objectRing->bind(OBJECT_BLOCK_BINDING, objectBlock);
+				if (depth) {
+					depthShader.use();
+					sceneArena->submit(depthShader);
+				}
+				else if (pipeline) {
+					pipeline->useStages(GL_VERTEX_SHADER_BIT, arenaProgram);
+					useProgram(arenaFragment);
+					sceneArena->submit(arenaFragment);
+				}
+				else {
+					arenaProgram.use();
+					sceneArena->submit(arenaProgram);
+				}
+			}
+			else if (depth) replayCommandList(commands, *objectRing, useDepthProgram);
+			else replayCommandList(commands, *objectRing, useProgram);
+			if (occlusionCulling) occlusionCuller->endConditional(erusaOcclusion);
+		};
+		if (prepass) {
+			if (drawErusa) {
+				depthPrepass->beginCount(SAMPLES_PREPASS);
+				drawErusaMeshes(heavyPrepassCommands, MESHES_OPAQUE, true);
+				depthPrepass->endCount();
+				if (pipeline) {
+					pipeline->bind();
+					pipeline->useStages(GL_VERTEX_SHADER_BIT, vertexProgram);
+				}
+			}
+			// lit pass: only the fragments that won the pre-pass run the lighting shader, then the cutout
+			// meshes are drawn and depth-tested as usual
+			sceneTimer->begin();
+			depthPrepass->beginShading();
+			depthPrepass->beginCount(SAMPLES_SHADED);
+			replayCommandList(roomCommands, *objectRing, useProgram);
+			if (drawErusa) drawErusaMeshes(heavyCommands, MESHES_OPAQUE, false);
+			depthPrepass->endCount();
+			depthPrepass->endShading();
+			depthPrepass->beginCount(SAMPLES_CUTOUT);
+			replayCommandList(roomCutoutCommands, *objectRing, useProgram);
+			if (drawErusa) drawErusaMeshes(heavyCutoutCommands, MESHES_CUTOUT, false);
+			depthPrepass->endCount();
+			sceneTimer->end();
+		}
+		else if (drawErusa) {
+			if (!deferredShadingEnable) depthPrepass->beginCount(SAMPLES_SHADED);
+			drawErusaMeshes(heavyCommands, MESHES_ALL, false);
+			depthPrepass->endCount();
+		}
+
+		// crowd: every visible copy is an arena instance, all of them go out in one submit with each mesh at its own LOD
+		crowdDrawn = crowdTriangles = 0;
+		for (unsigned int& count : crowdLodMeshes) count = 0;
+		if (crowdEnable) {
+			for (unsigned int c = 0; c < crowdCuller.size(); c++) {
+				if (!crowdCuller.visible(c)) continue;
+				int instance = sceneArena->addInstance(crowdWorld[c], crowdNormal[c]);
+				float pixels = pixelsPerUnit(crowdWorld[c], crowdBounds[c]);
+				for (unsigned int i = 0; i < erusa->meshes.size(); i++) {
+					unsigned int lod = meshLod(erusaArenaMesh + i, pixels);
+					sceneArena->queue(erusaArenaMesh + i, lod, instance);
+					crowdLodMeshes[lod]++;
+				}
+				crowdDrawn++;
+			}
+			crowdTimer->begin();
+			if (pipeline) {
+				pipeline->useStages(GL_VERTEX_SHADER_BIT, crowdProgram);
+				pipeline->activeProgram(crowdProgram);
+				crowdProgram.setInt("instances"_u, GeometryArena::INSTANCE_UNIT);
+				useProgram(arenaFragment);
+				sceneArena->submit(arenaFragment);
+			}
+			else {
+				crowdProgram.use();
+				crowdProgram.setInt("instances"_u, GeometryArena::INSTANCE_UNIT);
+				sceneArena->submit(crowdProgram);
+			}
+			crowdTriangles = sceneArena->triangleCount;
+			crowdTimer->end();
+		}
+
+		if (roomCuller.visible(pointlightBox)) {
+			if (pipeline) {
+				pipeline->useStages(GL_VERTEX_SHADER_BIT, instancedProgram);
+				useProgram(lightShader);
+				pointlightBatch->draw(lightShader);
+			}
+			else {
+				instancedProgram.use();
+				pointlightBatch->draw(instancedProgram);
+			}
+		}
+		objectRing->endFrame();
+
+		if (benchmarkRun >= 0 && ++benchmarkFrame > BENCHMARK_WARMUP) {
+			benchmarkGpuTime += sceneTimer->time;
+			benchmarkFrameTime += deltaTime * 1000.0;
+			if (benchmarkFrame == BENCHMARK_WARMUP + BENCHMARK_FRAMES) {
+				benchmarkResults.push_back(benchmarkGpuTime / BENCHMARK_FRAMES);
+				benchmarkResults.push_back(benchmarkFrameTime / BENCHMARK_FRAMES);
+				benchmarkFrame = 0;
+				benchmarkGpuTime = benchmarkFrameTime = 0.0;
+				if (++benchmarkRun == BENCHMARK_RUNS) {
+					for (int i = 0; i < BENCHMARK_RUNS / 2; i++) {
+						const double* result = &benchmarkResults[i * 4];
+						std::cout << "DEFERRED::BENCHMARK " << BENCHMARK_LIGHTS[i] << " lights: forward " << result[0] << " ms GPU, "
+							<< result[1] << " ms frame; deferred " << result[2] << " ms GPU, " << result[3] << " ms frame" << std::endl;
+					}
+					benchmarkRun = -1;
+					clusteredLightEnable = benchmarkSaved[0];
+					deferredShadingEnable = benchmarkSaved[1];
+					clusteredLightCount = benchmarkSavedCount;
+				}
+			}
+		}
+
+		if (lodBenchmarkRun >= 0 && ++lodBenchmarkFrame > BENCHMARK_WARMUP) {
+			lodBenchmarkSums[0] += crowdTimer->time;
+			lodBenchmarkSums[1] += deltaTime * 1000.0;
+			lodBenchmarkSums[2] += crowdTriangles;
+			if (lodBenchmarkFrame == BENCHMARK_WARMUP + BENCHMARK_FRAMES) {
+				for (double& sum : lodBenchmarkSums) {
+					lodBenchmarkResults.push_back(sum / BENCHMARK_FRAMES);
+					sum = 0.0;
+				}
+				lodBenchmarkFrame = 0;
+				if (++lodBenchmarkRun == 2) {
+					for (int i = 0; i < 2; i++) {
+						const double* result = &lodBenchmarkResults[i * 3];
+						std::cout << "GEOMETRYARENA::BENCHMARK " << CROWD_SIZE << " instances, " << (i ? "LOD" : "full detail") << ": "
+							<< result[2] / 1e6 << " M triangles, " << result[0] << " ms GPU (" << result[2] / 1e3 / result[0]
+							<< " M triangles/s), " << result[1] << " ms frame" << std::endl;
+					}
+					lodBenchmarkRun = -1;
+					crowdEnable = lodBenchmarkSaved[0];
+					meshLodEnable = lodBenchmarkSaved[1];
+				}
+			}
+		}
 
 		//Imgui
 		ImGui_ImplOpenGL3_NewFrame();
@@ -175,8 +978,95 @@ int main() {
 		ImGui::NewFrame();
 		ImGui::Begin("Menu");
 		ImGui::Text("camera info: ");
-		ImGui::Text("camera.position: %.2f %.2f %.2f", camera.position.x, camera.position.y, camera.position.z);
-		ImGui::Text("camera.front: %.2f %.2f %.2f", camera.front.x, camera.front.y, camera.front.z);
+		ImGui::Text("camera.position: %.2f %.2f %.2f", frame.cameraPosition.x, frame.cameraPosition.y, frame.cameraPosition.z);
+		ImGui::Text("camera.front: %.2f %.2f %.2f", frame.cameraFront.x, frame.cameraFront.y, frame.cameraFront.z);
+		ImGui::Separator();
+		ImGui::Text("shader startup: %.1f ms, %u programs, %u from binary cache", shaderBatch.buildTime, shaderBatch.size(),
+			shaderBatch.cacheHits);
+		ImGui::Text("uniform lookups avoided: %llu", shader.uniformLookupsAvoided + lightShader.uniformLookupsAvoided);
+		ImGui::Text("uniform writes: %u issued, %u skipped", Shader::writeStats().issued, Shader::writeStats().skipped);
+		ImGui::Separator();
+		ImGui::Checkbox("dirLight", &dirLightEnable);
+		ImGui::Checkbox("pointLight", &pointLightEnable);
+		ImGui::Checkbox("spotLight", &spotLightEnable);
+		ImGui::Checkbox("clustered lights", &clusteredLightEnable);
+		ImGui::SliderInt("clustered light count", &clusteredLightCount, 0, MAX_CLUSTERED_LIGHTS);
+		ImGui::Text("clusters %ux%ux%u: %u light indices, at most %u per cluster, %.3f ms assign (%s)", ClusteredLighting::GRID_X,
+			ClusteredLighting::GRID_Y, ClusteredLighting::GRID_Z, clusteredLighting->indexCount, clusteredLighting->maxPerCluster,
+			clusteredLighting->assignTime, TRANSFORMBATCH_PATH);
+		ImGui::Checkbox("deferred shading", &deferredShadingEnable);
+		ImGui::Checkbox("stencil light volumes", &deferredShading->stencilCulling);
+		ImGui::Text("lit room: %.3f ms GPU (%s), %u light volume draws", sceneTimer->time,
+			deferredShadingEnable ? "deferred" : prepass ? "after pre-pass, with erusa" : "forward",
+			deferredShadingEnable ? deferredShading->volumeDraws : 0u);
+		if (benchmarkRun >= 0)
+			ImGui::Text("benchmarking: run %d / %d", benchmarkRun + 1, BENCHMARK_RUNS);
+		else if (ImGui::Button("benchmark forward vs deferred")) {
+			benchmarkSaved[0] = clusteredLightEnable;
+			benchmarkSaved[1] = deferredShadingEnable;
+			benchmarkSavedCount = clusteredLightCount;
+			benchmarkResults.clear();
+			benchmarkRun = 0;
+		}
+		for (unsigned int i = 0; i + 4 <= benchmarkResults.size(); i += 4)
+			ImGui::Text("  %4d lights: forward %.3f / %.3f ms, deferred %.3f / %.3f ms (GPU / frame)", BENCHMARK_LIGHTS[i / 4],
+				benchmarkResults[i], benchmarkResults[i + 1], benchmarkResults[i + 2], benchmarkResults[i + 3]);
+		ImGui::Text("shader variants: %u", litShaders->size() + deferredLights->size());
+		ImGui::Text("program pipeline: %s", pipeline ? "shared vertex stage" : "off");
+		ImGui::Separator();
+		ImGui::Text("simulation: tick %llu at %.0f Hz, render %.2f ms", frame.tick, 1.0 / simulation->timestep, deltaTime * 1000.f);
+		ImGui::Text("snapshots: %llu published, %llu skipped, %llu steps dropped", frame.sequence, snapshotsSkipped,
+			(unsigned long long)simulation->droppedSteps);
+		ImGui::Text("scene nodes updated: %u / %u", frame.updatedNodes, (unsigned int)frame.world.size());
+		ImGui::Text("frustum culling: %u drawn, %u culled", roomCuller.drawn + heavyCuller.drawn, roomCuller.culled + heavyCuller.culled);
+		ImGui::Text("command lists: %u + %u commands, %u threads, %.3f ms", roomCommands.size(), heavyCommands.size(),
+			commandRecorder->threadCount(), commandRecorder->recordTime);
+		const renderQueueStats& queueStats = renderQueue.stats;
+		ImGui::Text("draws: %u", queueStats.draws);
+		ImGui::Text("program switches: %u -> %u", queueStats.programSwitches[0], queueStats.programSwitches[1]);
+		ImGui::Text("texture switches: %u -> %u", queueStats.textureSwitches[0], queueStats.textureSwitches[1]);
+		ImGui::Text("VAO switches: %u -> %u", queueStats.vaoSwitches[0], queueStats.vaoSwitches[1]);
+		ImGui::SliderInt("pointlight copies", &pointlightCopies, 1, 10000);
+		ImGui::Text("instanced: %u copies in %u draws", pointlightBatch->size(), pointlightBatch->drawCalls);
+		if (sceneArena->ready) ImGui::Checkbox("merged geometry", &mergedGeometry);
+		else ImGui::Text("merged geometry: unavailable, %u texture layers", sceneArena->layerCount());
+		ImGui::Text("arena (%s): %u meshes in %u draws, %u texture layers", glExt.multiDrawIndirect ? "multi-draw indirect" : "base vertex",
+			sceneArena->meshCount, sceneArena->drawCalls, sceneArena->layerCount());
+		ImGui::Checkbox("mesh LOD", &meshLodEnable);
+		ImGui::SliderFloat("LOD pixel error", &lodPixelError, .25f, 8.f);
+		ImGui::Text("LOD build: %.1f ms, %u triangles, %u in simplified levels", sceneArena->lodBuildTime,
+			sceneArena->lodSourceTriangles, sceneArena->lodSimplifiedTriangles);
+		if (sceneArena->ready) ImGui::Checkbox("crowd", &crowdEnable);
+		ImGui::Text("crowd: %u / %d drawn, %.2f M triangles, %.3f ms GPU, meshes per LOD %u %u %u %u", crowdDrawn, CROWD_SIZE,
+			crowdTriangles / 1e6, crowdTimer->time, crowdLodMeshes[0], crowdLodMeshes[1], crowdLodMeshes[2], crowdLodMeshes[3]);
+		if (lodBenchmarkRun >= 0)
+			ImGui::Text("benchmarking: run %d / 2", lodBenchmarkRun + 1);
+		else if (sceneArena->ready && ImGui::Button("benchmark crowd with and without LOD")) {
+			lodBenchmarkSaved[0] = crowdEnable;
+			lodBenchmarkSaved[1] = meshLodEnable;
+			lodBenchmarkResults.clear();
+			lodBenchmarkRun = 0;
+		}
+		for (unsigned int i = 0; i + 3 <= lodBenchmarkResults.size(); i += 3)
+			ImGui::Text("  %s: %.2f M triangles, %.3f ms GPU, %.3f ms frame", i ? "LOD" : "full detail",
+				lodBenchmarkResults[i + 2] / 1e6, lodBenchmarkResults[i], lodBenchmarkResults[i + 1]);
+		ImGui::Checkbox("occlusion culling", &occlusionCulling);
+		ImGui::Text("occlusion queries: %u, %.3f ms GPU", occlusionCuller->queryCount, occlusionCuller->queryTime);
+		for (unsigned int i = 0; i < occlusionCuller->size(); i++) {
+			const occlusionObject& object = occlusionCuller->object(i);
+			ImGui::Text("  %s: culled %u / %u frames", object.name.c_str(), object.culledFrames, object.frames);
+		}
+		ImGui::Checkbox("depth pre-pass", &depthPrepassEnable);
+		const unsigned long long* samples = depthPrepass->samples;
+		if (prepass)
+			ImGui::Text("shaded samples: %llu + %llu cutout, %llu without pre-pass", samples[SAMPLES_SHADED], samples[SAMPLES_CUTOUT],
+				samples[SAMPLES_PREPASS] + samples[SAMPLES_CUTOUT]);
+		else if (!deferredShadingEnable)
+			ImGui::Text("shaded samples: %llu", samples[SAMPLES_SHADED]);
+		ImGui::Text("alpha-cutout meshes: %u / %u", cutoutMeshes, (unsigned int)(floorCutout.size() + erusaCutout.size()));
+		ImGui::Separator();
+		ImGui::Text("object ring: %u blocks, %u bytes (%s)", objectRing->blockCount, objectRing->byteCount,
+			objectRing->persistent ? "persistent" : "orphaned");
 		ImGui::Separator();
 		ImGui::End();
 		ImGui::Render();
@@ -187,13 +1077,36 @@ int main() {
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+		applyWindowRequests(window);
 	}
 
+	// joined before anything the simulation touches is destroyed
+	delete simulation;
 	delete erusa;
 	delete floor;
+	delete pointlightBatch;
+	delete sceneArena;
+	delete occlusionCuller;
+	delete clusteredLighting;
+	delete deferredShading;
+	delete sceneTimer;
+	delete crowdTimer;
+	delete depthPrepass;
+	delete commandRecorder;
 	delete pointlight;
-	glDeleteProgram(shader.ID);
+	delete litShaders;
+	delete deferredLights;
+	delete objectRing;
+	delete pipeline;
+	glDeleteProgram(vertexProgram.ID);
 	glDeleteProgram(lightShader.ID);
+	glDeleteProgram(instancedProgram.ID);
+	glDeleteProgram(arenaProgram.ID);
+	glDeleteProgram(arenaFragment.ID);
+	glDeleteProgram(crowdProgram.ID);
+	glDeleteProgram(occlusionShader.ID);
+	glDeleteProgram(gbufferShader.ID);
+	glDeleteProgram(depthShader.ID);
 	glfwTerminate();
 
 	return 0;
@@ -205,17 +1118,31 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+// the input callbacks only queue the event, the simulation thread applies it
 void mouse_callback(GLFWwindow* window, double XposIn, double YposIn)
 {
-	camera.mouse_callback(window, XposIn, YposIn);
+	inputEvent event = { INPUT_CURSOR, XposIn, YposIn, 0, 0 };
+	inputEvents.push(event);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	camera.scroll_callback(window, xoffset, yoffset);
+	inputEvent event = { INPUT_SCROLL, xoffset, yoffset, 0, 0 };
+	inputEvents.push(event);
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	keyboard.cameraLock_key_callback(window, key, scancode, action, mods);
-	keyboard.mouse_display_key_callback(window, key, scancode, action, mods);
-}
\ No newline at end of file
+	inputEvent event = { INPUT_KEY, 0.0, 0.0, key, action };
+	inputEvents.push(event);
+}
+
+// after glfwPollEvents: carries out the cursor mode changes and the close request queued by the simulation
+void applyWindowRequests(GLFWwindow* window) {
+	static std::vector<windowRequest> requests;
+	requests.clear();
+	windowRequests.drain(requests);
+	for (windowRequest request : requests) {
+		if (request == WINDOW_CLOSE) glfwSetWindowShouldClose(window, GLFW_TRUE);
+		else glfwSetInputMode(window, GLFW_CURSOR, request == WINDOW_SHOW_CURSOR ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+	}
+}
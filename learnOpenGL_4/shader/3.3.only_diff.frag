@@ -1,15 +1,29 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec2 TexCoords;
+// separable programs match the vertex stage's outputs by name, and a differing set leaves every input undefined:
+// normal and fragPos are declared for 3.3.shader.vert even though only texCoord is read
+in vec3 normal;
+in vec3 fragPos;
+in vec2 texCoord;
+#ifdef MATERIAL_ARRAY
+// merged geometry: every diffuse texture is a layer of one array, -1 means untextured
+uniform sampler2DArray materials;
+flat in int materialLayer;
+#else
 struct Material{
 	sampler2D texture_diffuse1;
 };
 
 uniform Material material;
+#endif
 
 void main()
 {    
-    FragColor = texture(material.texture_diffuse1, TexCoords);
+#ifdef MATERIAL_ARRAY
+    FragColor = materialLayer < 0 ? vec4(1.f) : texture(materials, vec3(texCoord, float(materialLayer)));
+#else
+    FragColor = texture(material.texture_diffuse1, texCoord);
+#endif
     //FragColor = vec4(1.f);
 }
\ No newline at end of file
@@ -4,20 +4,47 @@ layout (location = 0) in vec3 vertPos;
 layout (location = 1) in vec3 vertNormal;
 layout (location = 2) in vec2 aTexCoord;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 nrmMat;
+#include "camera.glsl"
+#ifdef INSTANCED
+// per-instance matrices streamed by InstanceBatch, one attribute location per column
+layout (location = 8) in mat4 model;
+layout (location = 12) in mat4 nrmMat;
+#elif defined(INSTANCE_BUFFER)
+// GeometryArena instances: eight texels each, the model matrix columns then the normal matrix columns
+uniform samplerBuffer instances;
+mat4 model;
+mat4 nrmMat;
+#else
+#include "object.glsl"
+#endif
+#ifdef MATERIAL_ARRAY
+// per draw (see GeometryArena): texture array layer of the mesh and its instance, -1 for the Object block
+layout (location = 7) in ivec2 meshDraw;
+flat out int materialLayer;
+#endif
 
 out vec3 normal;
 out vec3 fragPos;
 out vec2 texCoord;
 
+// must match depth.vert bit for bit, the lit pass after a depth pre-pass tests with GL_EQUAL
+invariant gl_Position;
+
 void main(){
+#ifdef INSTANCE_BUFFER
+	int texel = meshDraw.y * 8;
+	model = mat4(texelFetch(instances, texel), texelFetch(instances, texel + 1),
+		texelFetch(instances, texel + 2), texelFetch(instances, texel + 3));
+	nrmMat = mat4(texelFetch(instances, texel + 4), texelFetch(instances, texel + 5),
+		texelFetch(instances, texel + 6), texelFetch(instances, texel + 7));
+#endif
 	gl_Position = projection * view * model * vec4(vertPos, 1.f);
 	fragPos = vec3(model * vec4(vertPos, 1.f));
 
 	vec4 nrm = nrmMat * vec4(vertNormal, 1.f);
 	normal = vec3(nrm.xyz);
 	texCoord = aTexCoord;
+#ifdef MATERIAL_ARRAY
+	materialLayer = meshDraw.x;
+#endif
 }
\ No newline at end of file
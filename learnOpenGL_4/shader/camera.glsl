@@ -0,0 +1,6 @@
+// per-frame camera data, uploaded once and shared by every program
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
\ No newline at end of file
@@ -0,0 +1,76 @@
+#version 330 core
+out vec4 fragColor;
+
+#include "camera.glsl"
+
+// G-buffer written by gbuffer.frag
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+#ifdef COMPOSITE
+// accumulated lighting, copied to the target framebuffer together with the G-buffer depth
+uniform sampler2D lightAccum;
+
+void main(){
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	fragColor = vec4(texelFetch(lightAccum, pixel, 0).rgb, 1.f);
+	gl_FragDepth = texelFetch(gDepth, pixel, 0).r;
+}
+#else
+struct Material{
+	float shininess;
+};
+
+uniform Material material;
+uniform mat4 inverseViewProjection;
+
+// surface of the current pixel, reconstructed from the G-buffer
+vec3 fragPos;
+vec3 diffuseColor;
+vec3 specularColor;
+#define LIGHT_DIFFUSE diffuseColor
+#define LIGHT_SPECULAR specularColor
+
+#include "light.glsl"
+
+#ifdef LIGHT_VOLUMES
+flat in vec4 lightPositionRadius;
+flat in vec4 lightColorInner;
+flat in vec4 lightDirectionOuter;
+#endif
+
+void main(){
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	// nothing was drawn here
+	if (depth >= 1.f) discard;
+
+	vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+	diffuseColor = albedoSpec.rgb;
+	specularColor = vec3(albedoSpec.a);
+	vec4 ndc = vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.f - 1.f, depth * 2.f - 1.f, 1.f);
+	vec4 world = inverseViewProjection * ndc;
+	fragPos = world.xyz / world.w;
+
+	vec3 norm = normalize(texelFetch(gNormal, pixel, 0).xyz);
+	vec3 viewDir = normalize(viewPos - fragPos);
+
+	vec3 result = vec3(0.f);
+#ifdef LIGHT_VOLUMES
+	result += CalcClusterLight(lightPositionRadius, lightColorInner, lightDirectionOuter, norm, viewDir, diffuseColor, specularColor);
+#endif
+#ifdef DIR_LIGHT
+	result += CalcDirLight(dirLight, norm, viewDir);
+#endif
+#ifdef POINT_LIGHT
+	for(int i = 0; i < NR_POINT_LIGHTS; i++)
+		result += CalcPointLight(pointLights[i], norm, fragPos, viewDir);
+#endif
+#ifdef SPOT_LIGHT
+	result += CalcSpotLight(spotLight, norm, viewDir);
+#endif
+
+	fragColor = vec4(result, 1.f);
+}
+#endif
@@ -0,0 +1,29 @@
+#version 330 core
+
+#include "camera.glsl"
+
+#ifdef LIGHT_VOLUMES
+// unit sphere scaled to the light radius, one instance per light of the clustered pool
+layout (location = 0) in vec3 vertPos;
+
+uniform samplerBuffer clusterLights;
+uniform int firstLight;
+
+flat out vec4 lightPositionRadius;
+flat out vec4 lightColorInner;
+flat out vec4 lightDirectionOuter;
+
+void main(){
+	int light = (firstLight + gl_InstanceID) * 3;
+	lightPositionRadius = texelFetch(clusterLights, light);
+	lightColorInner = texelFetch(clusterLights, light + 1);
+	lightDirectionOuter = texelFetch(clusterLights, light + 2);
+	gl_Position = projection * view * vec4(lightPositionRadius.xyz + vertPos * lightPositionRadius.w, 1.f);
+}
+#else
+// fullscreen triangle from gl_VertexID, drawn without vertex buffers
+void main(){
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.f - 1.f, 0.f, 1.f);
+}
+#endif
@@ -0,0 +1,6 @@
+#version 330 core
+
+// color writes are masked off during the depth pre-pass, only the depth is kept
+void main()
+{
+}
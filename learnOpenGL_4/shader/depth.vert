@@ -0,0 +1,14 @@
+#version 330 core
+
+// depth pre-pass: position only. gl_Position is invariant here and in 3.3.shader.vert,
+// so the lit pass reproduces these depths exactly and passes GL_EQUAL
+layout (location = 0) in vec3 vertPos;
+
+#include "camera.glsl"
+#include "object.glsl"
+
+invariant gl_Position;
+
+void main(){
+	gl_Position = projection * view * model * vec4(vertPos, 1.f);
+}
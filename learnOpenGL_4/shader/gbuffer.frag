@@ -0,0 +1,23 @@
+#version 330 core
+// deferred geometry pass: surface attributes only, lighting happens in deferred.frag
+layout (location = 0) out vec4 gAlbedoSpec;	// diffuse color, specular intensity
+layout (location = 1) out vec4 gNormal;	// world-space normal
+layout (location = 2) out float gDepth;	// window-space depth, read back by the lighting passes
+
+struct Material{
+	sampler2D texture_diffuse1;
+	sampler2D texture_specular1;
+	float shininess;
+};
+
+in vec3 normal;
+in vec3 fragPos;
+in vec2 texCoord;
+
+uniform Material material;
+
+void main(){
+	gAlbedoSpec = vec4(texture(material.texture_diffuse1, texCoord).rgb, texture(material.texture_specular1, texCoord).r);
+	gNormal = vec4(normalize(normal), 0.f);
+	gDepth = gl_FragCoord.z;
+}
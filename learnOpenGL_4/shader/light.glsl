@@ -0,0 +1,158 @@
+// light structs and lighting functions, stripped per variant by
+// DIR_LIGHT / POINT_LIGHT / SPOT_LIGHT / CLUSTERED_LIGHTS / LIGHT_VOLUMES so the program carries no dead branches
+// expects material and fragPos to be declared by the including shader; the surface colors default to
+// the material textures at texCoord, a shader without them (deferred lighting) defines its own
+
+#ifndef LIGHT_DIFFUSE
+#define LIGHT_DIFFUSE vec3(texture(material.texture_diffuse1, texCoord))
+#define LIGHT_SPECULAR vec3(texture(material.texture_specular1, texCoord))
+#endif
+
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 1
+#endif
+
+#ifdef DIR_LIGHT
+struct DirLight{
+	vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+uniform DirLight dirLight;
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir){
+	// calc diff & spec
+	vec3 lightDir = normalize(-light.direction);
+	float diff = max(0.f, dot(normal, lightDir));
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(0.f, dot(reflectDir, viewDir)), material.shininess);
+
+	vec3 ambient = light.ambient * LIGHT_DIFFUSE;
+	vec3 diffuse = light.diffuse * diff * LIGHT_DIFFUSE;
+	vec3 specular = light.specular * spec * LIGHT_SPECULAR;
+
+	return ambient + diffuse + specular;
+}
+#endif
+
+#ifdef POINT_LIGHT
+struct PointLight{
+	vec3 position;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float constant;
+	float linear;
+	float quadratic;
+};
+
+uniform PointLight pointLights[NR_POINT_LIGHTS];
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
+	// calc diff & spec
+	vec3 lightDir = normalize(light.position - fragPos);
+	float diff = max(0.f, dot(normal, lightDir));
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(0.f, dot(reflectDir, viewDir)), material.shininess);
+	// ˥
+	float distance = length(light.position - fragPos);
+	float attenuation = 1.f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+	
+	vec3 ambient = light.ambient * LIGHT_DIFFUSE * attenuation;
+	vec3 diffuse = light.diffuse * diff * LIGHT_DIFFUSE * attenuation;
+	vec3 specular = light.specular * spec * LIGHT_SPECULAR * attenuation;
+
+	return ambient + diffuse + specular;
+}
+#endif
+
+#ifdef SPOT_LIGHT
+struct SpotLight{
+	vec3 position;
+	vec3 direction;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float cutOff;	// Inner Cone
+	float outerCutOff;	// Outer Cone
+};
+
+uniform SpotLight spotLight;
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 viewDir){
+	vec3 lightDir = normalize(light.position - fragPos);
+	float diff = max(0.f, dot(normal, lightDir));
+	vec3 reflectDir = reflect(-lightDir,normal);
+	float spec = pow(max(0.f,  dot(reflectDir, viewDir)), material.shininess);
+
+	// SpotLight + Ե
+	float theta = dot(lightDir, normalize(-light.direction));
+	float epsilon = light.cutOff - light.outerCutOff;
+	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.f, 1.f);
+
+	vec3 ambient = light.ambient * LIGHT_DIFFUSE;
+	vec3 diffuse = light.diffuse * diff * LIGHT_DIFFUSE * intensity;
+	vec3 specular = light.specular * spec * LIGHT_SPECULAR * intensity;
+
+	return ambient + diffuse + specular;
+}
+#endif
+
+#if defined(CLUSTERED_LIGHTS) || defined(LIGHT_VOLUMES)
+// one light of the clustered pool, packed as in ClusteredLighting.h:
+// position + radius, color + cosInner, direction + cosOuter (below -1 for point lights)
+vec3 CalcClusterLight(vec4 positionRadius, vec4 colorInner, vec4 directionOuter, vec3 normal, vec3 viewDir,
+	vec3 diffuseColor, vec3 specularColor){
+	vec3 toLight = positionRadius.xyz - fragPos;
+	float distance = length(toLight);
+	vec3 lightDir = toLight / distance;
+	float diff = max(0.f, dot(normal, lightDir));
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(0.f, dot(reflectDir, viewDir)), material.shininess);
+	// windowed falloff, reaches zero at the radius the light was clustered with
+	float falloff = clamp(1.f - distance * distance / (positionRadius.w * positionRadius.w), 0.f, 1.f);
+	falloff *= falloff;
+	float theta = dot(lightDir, -directionOuter.xyz);
+	float intensity = clamp((theta - directionOuter.w) / (colorInner.w - directionOuter.w), 0.f, 1.f);
+
+	return colorInner.rgb * (diff * diffuseColor + spec * specularColor) * falloff * intensity;
+}
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+// clustered lights, assigned on the CPU by ClusteredLighting.h, 3 texels per light
+uniform samplerBuffer clusterLights;
+// per cluster: first index into clusterIndices, light count
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+
+layout (std140) uniform Clusters {
+	uint clusterCountX;
+	uint clusterCountY;
+	uint clusterCountZ;
+	uint clusterLightCount;
+	vec2 clusterTileSize;	// pixels
+	float clusterSliceScale;	// slice = log(depth) * scale + bias
+	float clusterSliceBias;
+};
+
+vec3 CalcClusteredLights(vec3 normal, vec3 viewDir){
+	float depth = -(view * vec4(fragPos, 1.f)).z;
+	uvec3 cell = uvec3(uvec2(gl_FragCoord.xy / clusterTileSize), uint(max(log(depth) * clusterSliceScale + clusterSliceBias, 0.f)));
+	cell = min(cell, uvec3(clusterCountX, clusterCountY, clusterCountZ) - 1u);
+	uint cluster = cell.x + clusterCountX * (cell.y + clusterCountY * cell.z);
+	uvec2 range = texelFetch(clusterRanges, int(cluster)).xy;
+
+	vec3 diffuseColor = LIGHT_DIFFUSE;
+	vec3 specularColor = LIGHT_SPECULAR;
+	vec3 result = vec3(0.f);
+	for(uint i = 0u; i < range.y; i++){
+		int light = int(texelFetch(clusterIndices, int(range.x + i)).x) * 3;
+		result += CalcClusterLight(texelFetch(clusterLights, light), texelFetch(clusterLights, light + 1),
+			texelFetch(clusterLights, light + 2), normal, viewDir, diffuseColor, specularColor);
+	}
+	return result;
+}
+#endif
@@ -0,0 +1,5 @@
+// per-draw data, streamed through the uniform ring and bound with glBindBufferRange
+layout (std140) uniform Object {
+	mat4 model;
+	mat4 nrmMat;
+};
\ No newline at end of file
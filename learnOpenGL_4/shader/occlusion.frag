@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// color writes are masked off during occlusion tests, only the samples passing the depth test matter
+void main()
+{
+    FragColor = vec4(1.f);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+layout (location = 0) in vec3 vertPos;
+
+#include "camera.glsl"
+
+// world-space bounding box as a transform of the unit cube [-1, 1]^3
+uniform mat4 box;
+
+void main(){
+	gl_Position = projection * view * box * vec4(vertPos, 1.f);
+}